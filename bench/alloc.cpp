@@ -0,0 +1,34 @@
+//cons 单元分配吞吐量：反复建立并丢弃一个一万项的列表，
+//比较 std::make_shared 与 PairValue::create 使用的线程局部内存池
+#include <chrono>
+#include <iostream>
+#include "value.h"
+
+namespace {
+constexpr int ROUNDS = 200;
+constexpr int LENGTH = 10000;
+
+//返回每秒分配的 cons 单元数（百万）
+template <typename F>
+double millionPairsPerSecond(F cons) {
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        ValuePtr list = NilValue::create();
+        for (int i = 0; i < LENGTH; ++i) list = cons(NumericValue::create(i % 100), list);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(ROUNDS) * LENGTH / elapsed.count() / 1e6;
+}
+}
+
+int main() {
+    double shared = millionPairsPerSecond([](const ValuePtr& car, const ValuePtr& cdr) -> ValuePtr {
+        return std::make_shared<PairValue>(car, cdr);
+    });
+    double pool = millionPairsPerSecond([](const ValuePtr& car, const ValuePtr& cdr) {
+        return PairValue::create(car, cdr);
+    });
+    std::cout << "make_shared: " << shared << " M pairs/s\n";
+    std::cout << "pool:        " << pool << " M pairs/s\n";
+    return 0;
+}
@@ -0,0 +1,9 @@
+; 创建一百万个闭包：next 引用自身，闭包与它所在的环境（或捕获的盒子）互相引用，
+; 只能由循环回收器释放，峰值内存应与调用次数无关
+(define (make-counter n)
+  (define (next) (if (< n 0) next (+ n 1)))
+  next)
+(define (loop i acc)
+  (if (= i 0) acc (loop (- i 1) ((make-counter acc)))))
+(display (loop 1000000 0))
+(newline)
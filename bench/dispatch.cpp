@@ -0,0 +1,66 @@
+//类型判断的微基准：EvalEnv::eval 对每个结点依次调用 isSeflEvaluating / isNil / asSymbol / isList，
+//比较旧的 dynamic_cast 实现与现在的内联类型标签，输出每个结点的平均耗时
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#include "value.h"
+
+namespace {
+constexpr int ROUNDS = 3000;
+
+//改用类型标签之前 value.cpp 中的实现
+namespace viaCast {
+bool isNil(Value* value) {
+    return dynamic_cast<NilValue*>(value) != nullptr;
+}
+bool isSeflEvaluating(Value* value) {
+    return dynamic_cast<BooleanValue*>(value) || dynamic_cast<NumericValue*>(value) ||
+           dynamic_cast<StringValue*>(value) || dynamic_cast<BuiltinProcValue*>(value);
+}
+std::optional<std::string> asSymbol(Value* value) {
+    if (auto symbol = dynamic_cast<SymbolValue*>(value)) return symbol->toString();
+    return std::nullopt;
+}
+bool isList(Value* value) {
+    if (typeid(*value) == typeid(NilValue)) return true;
+    if (auto pair = dynamic_cast<PairValue*>(value)) return isList(pair->getCdr().get());
+    return false;
+}
+}
+
+template <typename F>
+double nsPerNode(const std::vector<ValuePtr>& nodes, F classify) {
+    long hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (auto& node : nodes) hits += classify(node.get());
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    if (hits != static_cast<long>(ROUNDS) * nodes.size()) std::cerr << "unexpected hits: " << hits << "\n";
+    return elapsed.count() / (static_cast<double>(ROUNDS) * nodes.size());
+}
+}
+
+int main() {
+    //符号、数和调用各占三分之一
+    std::vector<ValuePtr> nodes;
+    for (int i = 0; i < 1000; ++i) {
+        nodes.push_back(SymbolValue::intern("x"));
+        nodes.push_back(NumericValue::create(i));
+        nodes.push_back(PairValue::create(SymbolValue::intern("f"),
+                                          PairValue::create(NumericValue::create(1), NilValue::create())));
+    }
+    double cast = nsPerNode(nodes, [](Value* node) {
+        return viaCast::isSeflEvaluating(node) || viaCast::isNil(node) || viaCast::asSymbol(node) ||
+               viaCast::isList(node);
+    });
+    double tag = nsPerNode(nodes, [](Value* node) {
+        return node->isSeflEvaluating() || node->isNil() || node->asSymbol() || node->isList();
+    });
+    std::cout << "dynamic_cast: " << cast << " ns/node\n";
+    std::cout << "type tag:     " << tag << " ns/node\n";
+    return 0;
+}
@@ -0,0 +1,11 @@
+; 全局绑定一个一百万项的列表后调用 30 万次不能复用帧的小过程。
+; 回收阈值只按环境计数时，每一万次调用就要遍历一遍整个列表（约 9 秒）；
+; 阈值计入存活的容器值后回收次数与堆的大小成反比
+(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))
+(define big (build 1000000 '()))
+(define (id x) `(,x))
+(define (run n) (if (= n 0) 'done (begin (id n) (run (- n 1)))))
+(display (run 300000))
+(newline)
+(display (length big))
+(newline)
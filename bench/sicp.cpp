@@ -0,0 +1,46 @@
+//SICP 计时：在新的全局环境中把 rjsj_test.hpp 里 Sicp 组的输入依次求值若干轮，输出每轮的平均耗时。
+//用法：bench_sicp [--vm] [轮数，默认 100]。计时包括词法分析和语法分析，程序的输出被丢弃
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "eval_env.h"
+#include "parse.h"
+#include "rjsj_test.hpp"
+#include "tokenizer.h"
+#include "vm.h"
+
+int main(int argc, char* argv[]) {
+    bool useVM = false;
+    int rounds = 100;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--vm") {
+            useVM = true;
+        } else {
+            rounds = std::atoi(argv[i]);
+        }
+    }
+    auto out = std::cout.rdbuf();
+    std::ostringstream sink;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        auto env = EvalEnv::createGlobal();
+        std::cout.rdbuf(sink.rdbuf());
+        for (const auto& [input, output] : RMLT_INTERNAL_CASE_PREFIXED(Sicp).cases) {
+            Parser parser(Tokenizer::tokenize(input));
+            if (useVM) {
+                VM::instance().eval(parser.parse(), env);
+            } else {
+                env->eval(parser.parse());
+            }
+        }
+        std::cout.rdbuf(out);
+        sink.str("");
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Sicp" << (useVM ? " [vm]" : "") << " x" << rounds << ": " << elapsed.count() / rounds
+              << " ms/round\n";
+    return 0;
+}
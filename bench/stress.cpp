@@ -0,0 +1,82 @@
+//运行一个 .scm 程序，报告耗时和进程的峰值常驻内存。
+//用法：bench_stress [--vm] [--max-rss-mb N] file.scm
+//求值出错或峰值内存超过上限时以非零状态退出，ctest 据此判断是否通过
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "error.h"
+#include "eval_env.h"
+#include "parse.h"
+#include "tokenizer.h"
+#include "vm.h"
+#if __has_include(<sys/resource.h>)
+#include <sys/resource.h>
+#define HAS_RUSAGE 1
+#endif
+
+namespace {
+//峰值常驻内存（MB），平台不支持时返回 0
+double peakRssMb() {
+#ifdef HAS_RUSAGE
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024.0 / 1024.0;//macOS 以字节为单位
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#else
+    return 0;
+#endif
+}
+}
+
+int main(int argc, char* argv[]) {
+    bool useVM = false;
+    double maxRssMb = 0;
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--vm") {
+            useVM = true;
+        } else if (arg == "--max-rss-mb" && i + 1 < argc) {
+            maxRssMb = std::stod(argv[++i]);
+        } else {
+            path = arg;
+        }
+    }
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Usage: bench_stress [--vm] [--max-rss-mb N] file.scm\n";
+        return 2;
+    }
+    std::stringstream source;
+    source << file.rdbuf();
+
+    auto env = EvalEnv::createGlobal();
+    auto start = std::chrono::steady_clock::now();
+    try {
+        Parser parser(Tokenizer::tokenize(source.str()));
+        while (!parser.empty()) {
+            auto expr = parser.parse();
+            if (useVM) {
+                VM::instance().eval(expr, env);
+            } else {
+                env->eval(expr);
+            }
+        }
+    } catch (std::runtime_error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    double rss = peakRssMb();
+    std::cout << path << (useVM ? " [vm]" : "") << ": " << elapsed.count() << " ms, peak RSS " << rss << " MB\n";
+    if (maxRssMb > 0 && rss > maxRssMb) {
+        std::cerr << "peak RSS exceeds " << maxRssMb << " MB\n";
+        return 1;
+    }
+    return 0;
+}
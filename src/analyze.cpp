@@ -0,0 +1,948 @@
+#include "./analyze.h"
+#include "./error.h"
+#include "./forms.h"
+#include "./builtins.h"
+#include <algorithm>
+#include <iterator>
+#include <ranges>
+
+ValuePtr TailNode::eval(EvalEnv& env) {
+    TailCall tail;
+    if (auto result = evalTail(env, tail)) {
+        return result;
+    }
+    return env.apply(tail.proc, tail.args.span());
+}
+
+ConstantNode::ConstantNode(ValuePtr value) : value{std::move(value)} {}
+ValuePtr ConstantNode::eval(EvalEnv& env) {
+    return value;
+}
+std::optional<Folded> ConstantNode::folded() const {
+    return Folded{value, {}};
+}
+
+//常量折叠的结果。每次求值先检查折叠所依赖的运算符是否仍是原来的内置过程
+class FoldedNode : public Node {
+    NodePtr fast;
+    NodePtr slow;
+    std::vector<FoldGuard> guards;
+    bool holds(EvalEnv& env) const {
+        for (auto& guard : guards) {
+            if (guard.op->eval(env).get() != guard.builtin) return false;
+        }
+        return true;
+    }
+public:
+    FoldedNode(NodePtr fast, NodePtr slow, std::vector<FoldGuard> guards)
+        : fast{std::move(fast)}, slow{std::move(slow)}, guards{std::move(guards)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        return (holds(env) ? fast : slow)->eval(env);
+    }
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        return (holds(env) ? fast : slow)->evalTail(env, tail);
+    }
+    std::optional<Folded> folded() const override {
+        auto result = fast->folded();
+        if (result) Analyzer::mergeGuards(result->guards, guards);
+        return result;
+    }
+};
+NodePtr Analyzer::guarded(NodePtr fast, NodePtr slow, std::vector<FoldGuard> guards) {
+    if (guards.empty()) return fast;
+    return std::make_shared<FoldedNode>(std::move(fast), std::move(slow), std::move(guards));
+}
+void Analyzer::mergeGuards(std::vector<FoldGuard>& into, const std::vector<FoldGuard>& from) {
+    for (auto& guard : from) {
+        if (std::ranges::none_of(into, [&](const FoldGuard& existing) { return existing.name == guard.name; })) {
+            into.push_back(guard);
+        }
+    }
+}
+
+//局部变量引用：向上 depth 层的帧中的第 slot 个槽位
+class LocalVariableNode : public Node {
+    std::size_t depth;
+    std::size_t slot;
+    SymbolId name;
+public:
+    LocalVariableNode(std::size_t depth, std::size_t slot, SymbolId name) : depth{depth}, slot{slot}, name{name} {}
+    ValuePtr eval(EvalEnv& env) override {
+        auto& frame = env.ancestor(depth);
+        if (auto& value = frame.slot(slot)) {
+            return value;
+        }
+        //内部 define 尚未执行，和按名字查找时一样到外层继续找
+        return frame.getParent()->lookupBinding(name);
+    }
+};
+
+//可能存放存储单元的局部变量：被闭包捕获后槽位中是 BoxValue，读取它的内容
+class BoxedVariableNode : public Node {
+    std::size_t depth;
+    std::size_t slot;
+    SymbolId name;
+public:
+    BoxedVariableNode(std::size_t depth, std::size_t slot, SymbolId name) : depth{depth}, slot{slot}, name{name} {}
+    ValuePtr eval(EvalEnv& env) override {
+        auto& frame = env.ancestor(depth);
+        const ValuePtr* value = &frame.slot(slot);
+        if (*value && (*value)->getType() == Type::Box) {
+            value = &static_cast<BoxValue&>(**value).get();
+        }
+        if (*value) {
+            return *value;
+        }
+        return frame.getParent()->lookupBinding(name);
+    }
+};
+
+//全局变量引用，带内联缓存：第一次查找后记住全局单元的地址，之后不再逐层查找。
+//只有在中间的帧运行时 define 了新名字（shadowEpoch 变化）后才重新查找，
+//此时若确实被遮蔽则返回遮蔽的绑定且不缓存
+class GlobalVariableNode : public Node {
+    SymbolId name;
+    ValuePtr* cell = nullptr;
+    std::size_t epoch = 0;
+public:
+    GlobalVariableNode(SymbolId name) : name{name} {}
+    ValuePtr eval(EvalEnv& env) override {
+        if (cell && epoch == EvalEnv::shadowEpoch) {
+            return *cell;
+        }
+        if (auto shadow = env.findShadow(name)) {
+            return *shadow;
+        }
+        cell = &env.globalCell(name);
+        epoch = EvalEnv::shadowEpoch;
+        return *cell;
+    }
+};
+
+namespace {
+//正在执行的内联函数体的实参，由 InlineCallNode 在执行函数体期间设置
+const ValuePtr* inlineArgs = nullptr;
+}
+//内联函数体中的形参引用
+class InlineArgNode : public Node {
+    std::size_t index;
+public:
+    InlineArgNode(std::size_t index) : index{index} {}
+    ValuePtr eval(EvalEnv& env) override {
+        return inlineArgs[index];
+    }
+};
+
+//无法静态解析的变量引用：在自身环境和上级环境中按名字查找
+class VariableNode : public Node {
+    SymbolId name;
+public:
+    VariableNode(SymbolId name) : name{name} {}
+    ValuePtr eval(EvalEnv& env) override {
+        return env.lookupBinding(name);
+    }
+};
+
+//set! 局部变量：改写向上 depth 层的帧中的第 slot 个槽位
+class LocalSetNode : public Node {
+    std::size_t depth;
+    std::size_t slot;
+    SymbolId name;
+    NodePtr value;
+public:
+    LocalSetNode(std::size_t depth, std::size_t slot, SymbolId name, NodePtr value)
+        : depth{depth}, slot{slot}, name{name}, value{std::move(value)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        auto result = value->eval(env);
+        auto& frame = env.ancestor(depth);
+        if (auto& target = frame.slot(slot)) {
+            target = std::move(result);
+        } else {
+            frame.getParent()->setBinding(name, std::move(result));//与读取一致，内部 define 之前改写外层的绑定
+        }
+        return NilValue::create();
+    }
+};
+//set! 可能存放存储单元的局部变量：槽位已换成存储单元时写入单元，捕获它的闭包也能看到新值
+class BoxedSetNode : public Node {
+    std::size_t depth;
+    std::size_t slot;
+    SymbolId name;
+    NodePtr value;
+public:
+    BoxedSetNode(std::size_t depth, std::size_t slot, SymbolId name, NodePtr value)
+        : depth{depth}, slot{slot}, name{name}, value{std::move(value)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        auto result = value->eval(env);
+        auto& frame = env.ancestor(depth);
+        ValuePtr* target = &frame.slot(slot);
+        if (*target && (*target)->getType() == Type::Box) {
+            target = &static_cast<BoxValue&>(**target).get();
+        }
+        if (*target) {
+            *target = std::move(result);
+        } else {
+            frame.getParent()->setBinding(name, std::move(result));
+        }
+        return NilValue::create();
+    }
+};
+//set! 全局变量，与 GlobalVariableNode 一样缓存全局单元的地址
+class GlobalSetNode : public Node {
+    SymbolId name;
+    NodePtr value;
+    ValuePtr* cell = nullptr;
+    std::size_t epoch = 0;
+public:
+    GlobalSetNode(SymbolId name, NodePtr value) : name{name}, value{std::move(value)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        auto result = value->eval(env);
+        if (!cell || epoch != EvalEnv::shadowEpoch) {
+            if (auto shadow = env.findShadow(name)) {
+                *shadow = std::move(result);
+                return NilValue::create();
+            }
+            cell = &env.globalCell(name);
+            epoch = EvalEnv::shadowEpoch;
+        }
+        *cell = std::move(result);
+        return NilValue::create();
+    }
+};
+//无法静态解析的 set!：按名字查找后改写
+class SetNode : public Node {
+    SymbolId name;
+    NodePtr value;
+public:
+    SetNode(SymbolId name, NodePtr value) : name{name}, value{std::move(value)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        env.setBinding(name, value->eval(env));
+        return NilValue::create();
+    }
+};
+
+//运算符是 + - * < > = <= >= 且有两个实参的调用点。
+//运算符求值后仍是原来的内置过程、两个实参都是数时直接计算，不经过 BuiltinProcValue::call；
+//运算符被重新定义或遮蔽（守卫失败）、实参不是数时，按一般的过程调用处理
+template <Primitive Op>
+class PrimitiveCallNode : public Node {
+    NodePtr proc;
+    NodePtr lhs;
+    NodePtr rhs;
+    const Value* builtin;
+public:
+    PrimitiveCallNode(NodePtr proc, NodePtr lhs, NodePtr rhs, const Value* builtin)
+        : proc{std::move(proc)}, lhs{std::move(lhs)}, rhs{std::move(rhs)}, builtin{builtin} {}
+    ValuePtr eval(EvalEnv& env) override {
+        ValuePtr procValue = proc->eval(env);
+        ValuePtr x = lhs->eval(env);
+        ValuePtr y = rhs->eval(env);
+        if (procValue.get() == builtin && x->getType() == Type::Number && y->getType() == Type::Number) {
+            return computePrimitive(Op, static_cast<NumericValue&>(*x).getVal(), static_cast<NumericValue&>(*y).getVal());
+        }
+        const ValuePtr args[] = {std::move(x), std::move(y)};
+        return env.apply(procValue, args);
+    }
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        ValuePtr procValue = proc->eval(env);
+        ValuePtr x = lhs->eval(env);
+        ValuePtr y = rhs->eval(env);
+        if (procValue.get() == builtin && x->getType() == Type::Number && y->getType() == Type::Number) {
+            return computePrimitive(Op, static_cast<NumericValue&>(*x).getVal(), static_cast<NumericValue&>(*y).getVal());
+        }
+        tail.proc = std::move(procValue);
+        tail.args.reset(2);
+        tail.args[0] = std::move(x);
+        tail.args[1] = std::move(y);
+        return nullptr;
+    }
+};
+NodePtr makePrimitiveCall(const PrimitiveInfo& info, NodePtr proc, NodePtr lhs, NodePtr rhs) {
+    switch (info.op) {
+#define PRIMITIVE_CASE(op) \
+        case Primitive::op: \
+            return std::make_shared<PrimitiveCallNode<Primitive::op>>(std::move(proc), std::move(lhs), std::move(rhs), info.builtin);
+        PRIMITIVE_CASE(Add)
+        PRIMITIVE_CASE(Subtract)
+        PRIMITIVE_CASE(Multiply)
+        PRIMITIVE_CASE(Less)
+        PRIMITIVE_CASE(Greater)
+        PRIMITIVE_CASE(Equal)
+        PRIMITIVE_CASE(LessEq)
+        PRIMITIVE_CASE(GreaterEq)
+#undef PRIMITIVE_CASE
+    }
+    return nullptr;
+}
+
+namespace {
+const SymbolId DEFINE = SymbolValue::idOf("define");
+const SymbolId DEFINE_MEMOIZED = SymbolValue::idOf("define-memoized");
+const SymbolId BEGIN = SymbolValue::idOf("begin");
+const SymbolId ELSE_SYMBOL = SymbolValue::idOf("else");
+const SymbolId QUOTE = SymbolValue::idOf("quote");
+const SymbolId IF = SymbolValue::idOf("if");
+const SymbolId AND = SymbolValue::idOf("and");
+const SymbolId OR = SymbolValue::idOf("or");
+const SymbolId COND = SymbolValue::idOf("cond");
+const SymbolId LET = SymbolValue::idOf("let");
+const SymbolId LAMBDA = SymbolValue::idOf("lambda");
+const SymbolId DELAY = SymbolValue::idOf("delay");
+const SymbolId CONS_STREAM = SymbolValue::idOf("cons-stream");
+const SymbolId DO = SymbolValue::idOf("do");
+const SymbolId SET = SymbolValue::idOf("set!");
+const SymbolId CASE = SymbolValue::idOf("case");
+const SymbolId EVAL = SymbolValue::idOf("eval");
+
+//扫描函数体：defined 收集 define 到本帧的名字，assigned 收集被 set! 的名字，captured 收集出现在内层闭包中的名字。
+//inClosure 表示 expr 位于某个内层闭包中，ownFrame 表示其中的 define 绑定到本帧。
+//不认识的特殊形式可能创建闭包，保守地当作闭包扫描
+void scanBindings(const ValuePtr& expr, bool inClosure, bool ownFrame, std::vector<SymbolId>& defined,
+                  std::vector<SymbolId>& assigned, std::vector<SymbolId>& captured) {
+    if (auto name = expr->asSymbolId()) {
+        if (inClosure) captured.push_back(*name);
+        return;
+    }
+    if (expr->getType() != Type::Pair || !expr->isList()) return;
+    auto pair = std::static_pointer_cast<PairValue>(expr);
+    auto head = pair->getCar()->asSymbolId();
+    auto items = pair->getCdr()->toVector();
+    auto scanAll = [&](auto begin, auto end, bool closure, bool own) {
+        for (auto it = begin; it != end; ++it) scanBindings(*it, closure, own, defined, assigned, captured);
+    };
+    if (head && !SPECIAL_FORMS.contains(*head) && isMacro(*head)) {
+        scanBindings(expandMacro(expr), inClosure, ownFrame, defined, assigned, captured);
+    } else if (!head || !SPECIAL_FORMS.contains(*head)) {
+        scanBindings(pair->getCar(), inClosure, ownFrame, defined, assigned, captured);
+        scanAll(items.begin(), items.end(), inClosure, ownFrame);
+    } else if (head == QUOTE) {
+    } else if ((head == DEFINE || head == DEFINE_MEMOIZED) && !items.empty()) {
+        auto target = items[0];
+        bool procedure = target->getType() == Type::Pair;
+        if (procedure) target = std::static_pointer_cast<PairValue>(target)->getCar();
+        if (auto name = target->asSymbolId(); name && ownFrame && !inClosure) defined.push_back(*name);
+        if (procedure) {
+            scanAll(items.begin() + 1, items.end(), true, false);
+        } else {
+            scanAll(items.begin() + 1, items.end(), inClosure, ownFrame);
+        }
+    } else if (head == SET) {
+        if (auto name = items.empty() ? std::nullopt : items[0]->asSymbolId()) assigned.push_back(*name);
+        scanAll(items.begin(), items.end(), inClosure, ownFrame);
+    } else if (head == LAMBDA || head == DELAY) {
+        scanAll(items.begin(), items.end(), true, false);
+    } else if (head == CONS_STREAM && !items.empty()) {
+        scanBindings(items[0], inClosure, ownFrame, defined, assigned, captured);
+        scanAll(items.begin() + 1, items.end(), true, false);
+    } else if (head == LET) {
+        //初值在本帧中求值，函数体中的 define 绑定到 let 自己的帧
+        if (!items.empty() && items[0]->isList()) {
+            for (auto& binding : items[0]->toVector()) {
+                if (binding->isList()) scanBindings(binding, inClosure, ownFrame, defined, assigned, captured);
+            }
+            scanAll(items.begin() + 1, items.end(), inClosure, false);
+        } else if (items.size() >= 2 && items[1]->isList()) {
+            //named let：不能原地循环时函数体属于一个递归过程
+            auto bindings = items[1]->toVector();
+            for (auto& binding : bindings) {
+                if (binding->isList()) scanBindings(binding, inClosure, ownFrame, defined, assigned, captured);
+            }
+            std::vector<ValuePtr> body(items.begin() + 2, items.end());
+            auto name = items[0]->asSymbolId();
+            bool loop = name && Analyzer::loopsInPlace(*name, bindings.size(), body);
+            scanAll(body.begin(), body.end(), inClosure || !loop, false);
+        } else {
+            scanAll(items.begin(), items.end(), true, false);
+        }
+    } else if (head == DO) {
+        //初值在本帧中求值，其余部分都在 do 自己的帧中
+        if (!items.empty() && items[0]->isList()) {
+            for (auto& spec : items[0]->toVector()) {
+                if (!spec->isList()) continue;
+                auto parts = spec->toVector();
+                if (parts.size() >= 2) scanBindings(parts[1], inClosure, ownFrame, defined, assigned, captured);
+                scanAll(parts.begin() + std::min<std::size_t>(parts.size(), 2), parts.end(), inClosure, false);
+            }
+        }
+        scanAll(items.begin() + std::min<std::size_t>(items.size(), 1), items.end(), inClosure, false);
+    } else if (head == BEGIN || head == IF || head == AND || head == OR || head == COND) {
+        scanAll(items.begin(), items.end(), inClosure, ownFrame);
+    } else if (head == CASE) {
+        //datum 列表不求值
+        scanAll(items.begin(), items.begin() + std::min<std::size_t>(items.size(), 1), inClosure, ownFrame);
+        for (std::size_t i = 1; i < items.size(); ++i) {
+            if (!items[i]->isList() || items[i]->isNil()) continue;
+            auto clause = items[i]->toVector();
+            scanAll(clause.begin() + 1, clause.end(), inClosure, ownFrame);
+        }
+    } else {
+        scanAll(items.begin(), items.end(), true, false);
+    }
+}
+
+//收集函数体顶层 define 的名字
+void collectDefines(const ValuePtr& expr, FrameLayout& layout) {
+    if (expr->getType() != Type::Pair || !expr->isList()) return;
+    auto pair = std::static_pointer_cast<PairValue>(expr);
+    auto head = pair->getCar()->asSymbolId();
+    if (head && !SPECIAL_FORMS.contains(*head) && isMacro(*head)) {
+        collectDefines(expandMacro(expr), layout);
+    } else if (head == BEGIN) {
+        for (auto& sub : pair->getCdr()->toVector()) collectDefines(sub, layout);
+    } else if ((head == DEFINE || head == DEFINE_MEMOIZED) && pair->getCdr()->getType() == Type::Pair) {
+        auto target = std::static_pointer_cast<PairValue>(pair->getCdr())->getCar();
+        if (target->getType() == Type::Pair) {
+            target = std::static_pointer_cast<PairValue>(target)->getCar();
+        }
+        auto name = target->asSymbolId();
+        if (name && std::ranges::find(layout, *name) == layout.end()) {
+            layout.push_back(*name);
+        }
+    }
+}
+}
+
+namespace {
+//实参都已知时在分析时调用纯内置过程。只折叠出数和布尔值，它们没有可观察的对象身份；
+//调用出错（例如除以零）时不折叠，留到运行时报告
+NodePtr foldCall(const PrimitiveFold& fold, const std::vector<NodePtr>& args, NodePtr op, NodePtr call) {
+    static const auto foldEnv = EvalEnv::createGlobal();//纯内置过程不使用环境
+    ArgBuffer values;
+    values.reset(args.size());
+    std::vector<FoldGuard> guards{{fold.name, std::move(op), fold.builtin}};
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        auto arg = args[i]->folded();
+        if (!arg) return call;
+        values[i] = std::move(arg->value);
+        Analyzer::mergeGuards(guards, arg->guards);
+    }
+    ValuePtr result;
+    try {
+        result = static_cast<const BuiltinProcValue&>(*fold.builtin).call(values.span(), *foldEnv);
+    } catch (LispError&) {
+        return call;
+    }
+    if (result->getType() != Type::Number && result->getType() != Type::Boolean) return call;
+    return Analyzer::guarded(std::make_shared<ConstantNode>(std::move(result)), std::move(call), std::move(guards));
+}
+}
+
+//过程调用：先求值运算符，再从左到右求值实参，最后用 EvalEnv::apply 调用
+class CallNode : public Node {
+    NodePtr proc;
+    std::vector<NodePtr> args;
+public:
+    CallNode(NodePtr proc, std::vector<NodePtr> args) : proc{std::move(proc)}, args{std::move(args)} {}
+    void evalArgs(EvalEnv& env, ArgBuffer& argValues) {
+        argValues.reset(args.size());
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            argValues[i] = args[i]->eval(env);
+        }
+    }
+    ValuePtr eval(EvalEnv& env) override {
+        ValuePtr procValue = proc->eval(env);
+        ArgBuffer argValues;
+        evalArgs(env, argValues);
+        return env.apply(procValue, argValues.span());
+    }
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        tail.proc = proc->eval(env);
+        evalArgs(env, tail.args);
+        return nullptr;
+    }
+};
+
+//named let 循环体中对循环名字的调用，只出现在尾位置：求出下一轮的实参，连同标记交给执行循环的结点
+class LoopCallNode : public TailNode {
+    ValuePtr marker;
+    std::vector<NodePtr> args;
+public:
+    LoopCallNode(ValuePtr marker, std::vector<NodePtr> args) : marker{std::move(marker)}, args{std::move(args)} {}
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        tail.proc = marker;
+        tail.args.reset(args.size());
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            tail.args[i] = args[i]->eval(env);
+        }
+        return nullptr;
+    }
+};
+
+//运算符是全局名字的调用点。
+//运算符的值是可内联的闭包时，求出实参后直接在它的环境中执行内联函数体；
+//每次都比较运算符的值，名字被重新定义后退回一般的调用，并检查新的值能否内联
+class InlineCallNode : public Node {
+    SymbolId name;
+    NodePtr proc;
+    std::vector<NodePtr> args;
+    const Value* checked = nullptr;//最近一次检查的运算符的值
+    ValuePtr callee;//checked 可以内联时持有它，保证地址不会被新对象复用；否则为空
+    //设置实参，离开时（包括异常）恢复外层内联函数体的实参
+    struct ArgsScope {
+        const ValuePtr* saved;
+        ArgsScope(const ValuePtr* args) : saved{inlineArgs} {
+            inlineArgs = args;
+        }
+        ~ArgsScope() {
+            inlineArgs = saved;
+        }
+    };
+    const LambdaValue* inlineTarget(const ValuePtr& procValue) {
+        if (procValue.get() == checked) {
+            return static_cast<const LambdaValue*>(callee.get());
+        }
+        checked = procValue.get();
+        callee = nullptr;
+        if (procValue->getType() != Type::Lambda) return nullptr;
+        auto& lambda = static_cast<const LambdaValue&>(*procValue);
+        if (lambda.inlined && lambda.arity == args.size() && !lambda.initEnv->getParent()
+            && std::ranges::find(lambda.inlined->globals, name) == lambda.inlined->globals.end()) {
+            callee = procValue;
+        }
+        return static_cast<const LambdaValue*>(callee.get());
+    }
+    void evalArgs(EvalEnv& env, ArgBuffer& argValues) {
+        argValues.reset(args.size());
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            argValues[i] = args[i]->eval(env);
+        }
+    }
+public:
+    InlineCallNode(SymbolId name, NodePtr proc, std::vector<NodePtr> args)
+        : name{name}, proc{std::move(proc)}, args{std::move(args)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        ValuePtr procValue = proc->eval(env);
+        ArgBuffer argValues;
+        evalArgs(env, argValues);
+        if (auto lambda = inlineTarget(procValue)) {
+            ArgsScope scope{argValues.span().data()};
+            return lambda->inlined->body->eval(*lambda->initEnv);
+        }
+        return env.apply(procValue, argValues.span());
+    }
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        ValuePtr procValue = proc->eval(env);
+        evalArgs(env, tail.args);
+        if (auto lambda = inlineTarget(procValue)) {
+            //实参在函数体执行期间必须保持不变，函数体自己的尾调用也会写入 tail.args
+            ArgBuffer argValues;
+            argValues.reset(args.size());
+            for (std::size_t i = 0; i < args.size(); ++i) {
+                argValues[i] = std::move(tail.args[i]);
+            }
+            ArgsScope scope{argValues.span().data()};
+            return lambda->inlined->body->evalTail(*lambda->initEnv, tail);
+        }
+        tail.proc = std::move(procValue);
+        return nullptr;
+    }
+};
+
+namespace {
+constexpr std::size_t INLINE_BUDGET = 24;//内联函数体最多包含的子表达式个数
+
+//表达式是否只由常量、变量、quote、if、and、or、begin、cond 和过程调用组成（不创建闭包和帧），且不超过预算。
+//同时收集形参以外的名字
+bool inlinable(const ValuePtr& expr, const FrameLayout& params, std::size_t& budget, std::vector<SymbolId>& globals) {
+    if (budget == 0) return false;
+    --budget;
+    if (expr->isSeflEvaluating()) return true;
+    if (auto name = expr->asSymbolId()) {
+        if (std::ranges::find(params, *name) == params.end() && std::ranges::find(globals, *name) == globals.end()) {
+            globals.push_back(*name);
+        }
+        return true;
+    }
+    if (expr->getType() != Type::Pair || !expr->isList()) return false;
+    auto pair = std::static_pointer_cast<PairValue>(expr);
+    auto head = pair->getCar()->asSymbolId();
+    if (head == QUOTE) return true;
+    if (head && !SPECIAL_FORMS.contains(*head) && isMacro(*head)) {
+        return inlinable(expandMacro(expr), params, budget, globals);
+    }
+    auto items = pair->getCdr()->toVector();
+    if (head == COND) {
+        for (auto& clause : items) {
+            if (clause->getType() != Type::Pair || !clause->isList()) return false;
+            for (auto& sub : clause->toVector()) {
+                if (sub->asSymbolId() != ELSE_SYMBOL && !inlinable(sub, params, budget, globals)) return false;
+            }
+        }
+        return true;
+    }
+    if (head && SPECIAL_FORMS.contains(*head)) {
+        if (head != IF && head != AND && head != OR && head != BEGIN) return false;
+    } else if (!inlinable(pair->getCar(), params, budget, globals)) {
+        return false;
+    }
+    for (auto& item : items) {
+        if (!inlinable(item, params, budget, globals)) return false;
+    }
+    return true;
+}
+}
+
+namespace {
+//expr 中 quote 之外的地方是否出现 name
+bool mentions(const ValuePtr& expr, SymbolId name) {
+    if (expr->getType() != Type::Pair) return expr->asSymbolId() == name;
+    auto pair = std::static_pointer_cast<PairValue>(expr);
+    if (pair->getCar()->asSymbolId() == QUOTE) return false;
+    return mentions(pair->getCar(), name) || mentions(pair->getCdr(), name);
+}
+bool captures(const ValuePtr& expr, bool flat) {
+    if (expr->getType() != Type::Pair || !expr->isList()) return false;
+    auto pair = std::static_pointer_cast<PairValue>(expr);
+    auto head = pair->getCar()->asSymbolId();
+    auto items = pair->getCdr()->toVector();
+    auto anyCaptures = [flat](std::span<const ValuePtr> exprs) {
+        return std::ranges::any_of(exprs, [flat](const ValuePtr& sub) { return captures(sub, flat); });
+    };
+    if (head && !SPECIAL_FORMS.contains(*head) && isMacro(*head)) {
+        return captures(expandMacro(expr), flat);
+    }
+    if (!head || !SPECIAL_FORMS.contains(*head)) {
+        return captures(pair->getCar(), flat) || anyCaptures(items);
+    }
+    if (head == QUOTE) return false;
+    if (head == IF || head == AND || head == OR || head == BEGIN) return anyCaptures(items);
+    if (head == COND) {
+        return std::ranges::any_of(items, [&](const ValuePtr& clause) {
+            return clause->isList() && anyCaptures(clause->toVector());
+        });
+    }
+    if (head == LAMBDA || head == DELAY) return !flat;
+    if (head == SET) return anyCaptures(items);
+    if (head == CASE) {
+        if (items.empty() || captures(items[0], flat)) return true;
+        return std::ranges::any_of(std::span(items).subspan(1), [&](const ValuePtr& clause) {
+            if (!clause->isList() || clause->isNil()) return false;
+            auto parts = clause->toVector();
+            return anyCaptures(std::span(parts).subspan(1));
+        });
+    }
+    if (head == CONS_STREAM) return !flat || (!items.empty() && captures(items[0], flat));
+    if (head == DEFINE || head == DEFINE_MEMOIZED) {
+        if (items.empty()) return true;
+        if (items[0]->getType() == Type::Pair) return !flat;
+        return anyCaptures(items);
+    }
+    if (head == LET) {
+        //let 自己的帧以当前帧为上级，但在 let 结束时随之释放，只要它的函数体不捕获即可
+        if (!items.empty() && items[0]->isList()) {
+            for (auto& binding : items[0]->toVector()) {
+                if (binding->isList() && anyCaptures(binding->toVector())) return true;
+            }
+            return anyCaptures(std::span(items).subspan(1));
+        }
+        //named let 原地循环时同 let，否则函数体属于一个递归过程
+        auto name = items.empty() ? std::nullopt : items[0]->asSymbolId();
+        if (!name || items.size() < 2 || !items[1]->isList()) return true;
+        auto bindings = items[1]->toVector();
+        for (auto& binding : bindings) {
+            if (!binding->isList() || anyCaptures(binding->toVector())) return true;
+        }
+        std::vector<ValuePtr> body(items.begin() + 2, items.end());
+        if (Analyzer::loopsInPlace(*name, bindings.size(), body)) return anyCaptures(body);
+        return !flat;
+    }
+    if (head == DO) {
+        //do 的各部分都在它自己的帧或当前帧中求值
+        if (items.empty() || !items[0]->isList()) return true;
+        for (auto& spec : items[0]->toVector()) {
+            if (!spec->isList() || anyCaptures(spec->toVector())) return true;
+        }
+        if (items.size() < 2 || !items[1]->isList() || anyCaptures(items[1]->toVector())) return true;
+        return anyCaptures(std::span(items).subspan(2));
+    }
+    return true;
+}
+}
+
+bool Analyzer::capturesFrame(const std::vector<ValuePtr>& body, bool flatClosures) {
+    //调用 eval 的闭包不转换为扁平闭包（见 usesEval），它们引用整个帧
+    if (usesEval(body)) flatClosures = false;
+    return std::ranges::any_of(body, [&](const ValuePtr& expr) { return captures(expr, flatClosures); });
+}
+
+bool Analyzer::usesEval(const std::vector<ValuePtr>& body) {
+    return std::ranges::any_of(body, [](const ValuePtr& expr) { return mentions(expr, EVAL); });
+}
+
+namespace {
+bool onlyTailCalls(const ValuePtr& expr, SymbolId name, std::size_t arity, bool tail);
+//依次执行的表达式：最后一个继承 tail，其余不在尾位置
+bool onlyTailCalls(std::span<const ValuePtr> exprs, SymbolId name, std::size_t arity, bool tail) {
+    for (std::size_t i = 0; i < exprs.size(); ++i) {
+        if (!onlyTailCalls(exprs[i], name, arity, tail && i + 1 == exprs.size())) return false;
+    }
+    return true;
+}
+//expr 中的 name 是否都是有 arity 个实参、且在（相对于循环体的）尾位置的调用的运算符。
+//尾位置与各结点的 evalTail 一致：if 的分支、begin/and/or 的最后一项、cond 和 case 子句体的最后一项、
+//let 和原地循环的 named let 的函数体。其他位置上出现 name 都不行
+bool onlyTailCalls(const ValuePtr& expr, SymbolId name, std::size_t arity, bool tail) {
+    if (expr->getType() != Type::Pair || !expr->isList()) return !mentions(expr, name);
+    auto pair = std::static_pointer_cast<PairValue>(expr);
+    auto head = pair->getCar()->asSymbolId();
+    auto items = pair->getCdr()->toVector();
+    auto none = [&](std::span<const ValuePtr> exprs) {
+        return std::ranges::none_of(exprs, [&](const ValuePtr& sub) { return mentions(sub, name); });
+    };
+    if (head == name) {
+        return tail && items.size() == arity && none(items);
+    }
+    if (head && !SPECIAL_FORMS.contains(*head) && isMacro(*head)) {
+        return onlyTailCalls(expandMacro(expr), name, arity, tail);
+    }
+    if (!head || !SPECIAL_FORMS.contains(*head)) return !mentions(expr, name);
+    if (head == QUOTE) return true;
+    if (head == IF) {
+        return !items.empty() && !mentions(items[0], name) && std::ranges::all_of(std::span(items).subspan(1), [&](const ValuePtr& branch) {
+            return onlyTailCalls(branch, name, arity, tail);
+        });
+    }
+    if (head == BEGIN || head == AND || head == OR) {
+        return onlyTailCalls(std::span<const ValuePtr>(items), name, arity, tail);
+    }
+    if (head == COND) {
+        return std::ranges::all_of(items, [&](const ValuePtr& clause) {
+            if (!clause->isList() || clause->isNil()) return !mentions(clause, name);
+            auto parts = clause->toVector();
+            return !mentions(parts[0], name) && onlyTailCalls(std::span(parts).subspan(1), name, arity, tail);
+        });
+    }
+    if (head == CASE) {
+        return !items.empty() && !mentions(items[0], name) && std::ranges::all_of(std::span(items).subspan(1), [&](const ValuePtr& clause) {
+            if (!clause->isList() || clause->isNil()) return !mentions(clause, name);
+            auto parts = clause->toVector();
+            return onlyTailCalls(std::span(parts).subspan(1), name, arity, tail);
+        });
+    }
+    if (head == LET && !items.empty()) {
+        //绑定的名字遮蔽 name 时，其中的 name 不再是这个循环
+        auto inner = items[0]->asSymbolId();
+        auto bindingList = inner ? (items.size() >= 2 ? items[1] : nullptr) : items[0];
+        if (!bindingList || !bindingList->isList() || inner == name) return !mentions(expr, name);
+        auto bindings = bindingList->toVector();
+        for (auto& binding : bindings) {
+            if (!binding->isList() || binding->isNil()) return !mentions(expr, name);
+            auto parts = binding->toVector();
+            if (parts[0]->asSymbolId() == name) return !mentions(expr, name);
+            if (!none(std::span(parts).subspan(1))) return false;
+        }
+        auto body = std::span(items).subspan(inner ? 2 : 1);
+        if (inner && !Analyzer::loopsInPlace(*inner, bindings.size(), std::vector<ValuePtr>(body.begin(), body.end()))) return none(body);
+        return onlyTailCalls(body, name, arity, tail);
+    }
+    return !mentions(expr, name);
+}
+}
+
+bool Analyzer::loopsInPlace(SymbolId name, std::size_t arity, const std::vector<ValuePtr>& body) {
+    if (SPECIAL_FORMS.contains(name) || isMacro(name)) return false;
+    return onlyTailCalls(std::span<const ValuePtr>(body), name, arity, true);
+}
+
+std::shared_ptr<const InlineBody> Analyzer::makeInline(const FrameLayout& params, const std::vector<ValuePtr>& body) {
+    std::size_t budget = INLINE_BUDGET;
+    std::vector<SymbolId> globals;
+    if (body.size() != 1 || !inlinable(body[0], params, budget, globals)) return nullptr;
+    //内联函数体中的调用不再内联，避免互相调用的小过程在 C++ 栈上无限展开
+    Analyzer analyzer;
+    analyzer.inlineParams = &params;
+    try {
+        return std::make_shared<const InlineBody>(InlineBody{analyzer.analyze(body[0]), std::move(globals)});
+    } catch (LispError&) {
+        return nullptr;//语法错误留给调用时报告，与不内联时一致
+    }
+}
+
+NodePtr Analyzer::analyze(const ValuePtr& expr) {
+    if (expr->isSeflEvaluating()) {
+        return std::make_shared<ConstantNode>(expr);
+    } else if (expr->isNil()) {
+        throw LispError("Evaluating nil is prohibited.");
+    } else if (auto name = expr->asSymbolId()) {
+        if (inlineParams) {
+            if (auto it = std::ranges::find(*inlineParams, *name); it != inlineParams->end()) {
+                return std::make_shared<InlineArgNode>(it - inlineParams->begin());
+            }
+        }
+        if (auto address = resolve(*name, scope)) {
+            if (address->boxed) {
+                return std::make_shared<BoxedVariableNode>(address->depth, address->slot, *name);
+            }
+            return std::make_shared<LocalVariableNode>(address->depth, address->slot, *name);
+        }
+        if (dynamic) {
+            return std::make_shared<VariableNode>(*name);
+        }
+        return std::make_shared<GlobalVariableNode>(*name);
+    } else if (expr->isList()) {
+        auto pair = std::static_pointer_cast<PairValue>(expr);
+        auto car = pair->getCar();
+        if (auto name = car->asSymbolId()) {
+            //特殊形式
+            if (auto form = SPECIAL_FORMS.find(*name); form != SPECIAL_FORMS.end()) {
+                return form->second(pair->getCdr()->toVector(), *this);
+            }
+            if (auto expansion = expandMacro(expr)) {
+                return analyze(expansion);
+            }
+            for (auto loop = loops.rbegin(); loop != loops.rend(); ++loop) {
+                if (loop->name == *name) {
+                    return std::make_shared<LoopCallNode>(loop->marker, analyzeList(pair->getCdr()->toVector()));
+                }
+            }
+        } else if (car->getType() != Type::Pair) {
+            throw LispError("first argument should be symbol");
+        }
+        auto args = analyzeList(pair->getCdr()->toVector());
+        auto proc = analyze(car);
+        NodePtr call;
+        if (auto name = car->asSymbolId(); name && args.size() == 2) {
+            if (auto primitive = findPrimitive(*name)) {
+                call = makePrimitiveCall(*primitive, proc, args[0], args[1]);
+            }
+        }
+        if (!call) {
+            auto name = car->asSymbolId();
+            if (name && !inlineParams && !isLocal(*name)) {
+                call = std::make_shared<InlineCallNode>(*name, proc, args);
+            } else {
+                call = std::make_shared<CallNode>(proc, args);
+            }
+        }
+        //局部变量遮蔽的运算符在分析时就能排除
+        if (auto name = car->asSymbolId(); name && constantFolding && !isLocal(*name)) {
+            if (auto fold = findFoldable(*name)) {
+                return foldCall(*fold, args, std::move(proc), std::move(call));
+            }
+        }
+        return call;
+    } else {
+        throw LispError("Unimplemented");
+    }
+}
+NodePtr Analyzer::analyzeAssignment(SymbolId name, NodePtr value) {
+    if (auto address = resolve(name, scope)) {
+        if (address->boxed) {
+            return std::make_shared<BoxedSetNode>(address->depth, address->slot, name, std::move(value));
+        }
+        return std::make_shared<LocalSetNode>(address->depth, address->slot, name, std::move(value));
+    }
+    if (dynamic) {
+        return std::make_shared<SetNode>(name, std::move(value));
+    }
+    return std::make_shared<GlobalSetNode>(name, std::move(value));
+}
+std::vector<NodePtr> Analyzer::analyzeList(const std::vector<ValuePtr>& exprs) {
+    std::vector<NodePtr> nodes;
+    std::ranges::transform(exprs, std::back_inserter(nodes),
+                           [this](const ValuePtr& expr) { return analyze(expr); });
+    return nodes;
+}
+
+bool Analyzer::Scope::isBoxed(SymbolId name) const {
+    return std::ranges::find(boxed, name) != boxed.end();
+}
+std::optional<Analyzer::Address> Analyzer::resolve(SymbolId name, Scope* from) {
+    std::size_t depth = 0;
+    for (auto current = from; current; current = current->parent, ++depth) {
+        auto& layout = *current->layout;
+        if (auto it = std::ranges::find(layout, name); it != layout.end()) {
+            return Address{depth, std::size_t(it - layout.begin()), current->isBoxed(name)};
+        }
+        if (current->captures) {
+            //闭包帧的上级是捕获帧，捕获帧的上级是全局环境
+            auto& captures = *current->captures;
+            auto it = std::ranges::find(captures, name, &Capture::name);
+            if (it == captures.end()) {
+                auto source = resolve(name, current->parent);
+                if (!source) return std::nullopt;
+                captures.push_back({name, source->depth, source->slot, source->boxed});
+                it = captures.end() - 1;
+            }
+            return Address{depth + 1, std::size_t(it - captures.begin()), it->boxed};
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<NodePtr> Analyzer::analyzeBody(const std::vector<ValuePtr>& body, const std::shared_ptr<FrameLayout>& layout,
+                                           std::vector<Capture>* captures) {
+    for (auto& expr : body) {
+        collectDefines(expr, *layout);
+    }
+    Scope inner{layout, scope};
+    inner.captures = captures;
+    //闭包捕获的变量通常直接复制值；只有帧创建之后才绑定的（define 的）和会被 set! 改写的变量要放进存储单元，
+    //这样闭包创建之后的 define（例如递归的内部过程绑定自身）和赋值对闭包可见，闭包中的赋值对本帧可见。
+    //没有被闭包捕获的变量即使被赋值也只是直接改写槽位
+    std::vector<SymbolId> defined;
+    std::vector<SymbolId> assigned;
+    std::vector<SymbolId> captured;
+    for (auto& expr : body) {
+        scanBindings(expr, false, true, defined, assigned, captured);
+    }
+    defined.insert(defined.end(), assigned.begin(), assigned.end());
+    for (auto name : defined) {
+        if (std::ranges::find(captured, name) != captured.end()) inner.boxed.push_back(name);
+    }
+    scope = &inner;
+    try {
+        auto nodes = analyzeList(body);
+        scope = inner.parent;
+        return nodes;
+    } catch (...) {
+        scope = inner.parent;
+        throw;
+    }
+}
+std::vector<NodePtr> Analyzer::analyzeLoopBody(const std::vector<ValuePtr>& body, const std::shared_ptr<FrameLayout>& layout,
+                                               SymbolId name, ValuePtr marker) {
+    loops.push_back({name, std::move(marker)});
+    try {
+        auto nodes = analyzeBody(body, layout);
+        loops.pop_back();
+        return nodes;
+    } catch (...) {
+        loops.pop_back();
+        throw;
+    }
+}
+bool Analyzer::isLocal(SymbolId name) const {
+    for (auto current = scope; current; current = current->parent) {
+        if (std::ranges::find(*current->layout, name) != current->layout->end()) return true;
+    }
+    return false;
+}
+std::optional<std::size_t> Analyzer::defineSlot(SymbolId name) {
+    if (!scope) {
+        return std::nullopt;
+    }
+    auto& layout = *scope->layout;
+    if (auto it = std::ranges::find(layout, name); it != layout.end()) {
+        return it - layout.begin();
+    }
+    layout.push_back(name);
+    return layout.size() - 1;
+}
+
+ValuePtr evalSequence(const std::vector<NodePtr>& nodes, EvalEnv& env) {
+    ValuePtr res = NilValue::create();
+    for (auto& node : nodes) {
+        res = node->eval(env);
+    }
+    return res;
+}
+ValuePtr evalSequenceTail(const std::vector<NodePtr>& nodes, EvalEnv& env, TailCall& tail) {
+    if (nodes.empty()) {
+        return NilValue::create();
+    }
+    for (std::size_t i = 0; i + 1 < nodes.size(); ++i) {
+        nodes[i]->eval(env);
+    }
+    return nodes.back()->evalTail(env, tail);
+}
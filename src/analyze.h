@@ -0,0 +1,163 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+#include <memory>
+#include <optional>
+#include <vector>
+#include "./value.h"
+#include "./eval_env.h"
+
+//语法分析后的可执行结点。
+//s-表达式只在分析时检查一次（是否为列表、是否为特殊形式、参数个数等），
+//之后每次求值直接执行结点，不再重新遍历原始列表。
+//尾位置上推迟执行的过程调用。
+//闭包体最后的调用不在 C++ 栈上递归，而是交回 LambdaValue::apply 的循环继续执行，
+//因此尾递归写成的循环只占用常数的栈空间。
+struct TailCall {
+    ValuePtr proc;
+    ArgBuffer args;
+};
+
+//常量折叠的前提：name 在求值时仍绑定原来的内置过程。op 是分析 name 得到的变量引用结点
+struct FoldGuard {
+    SymbolId name;
+    NodePtr op;
+    const Value* builtin;
+};
+//分析时已知的值，只要 guards 全部成立，求值结点就得到它且没有副作用
+struct Folded {
+    ValuePtr value;
+    std::vector<FoldGuard> guards;
+};
+
+class Node {
+public:
+    virtual ~Node() = default;
+    virtual ValuePtr eval(EvalEnv& env) = 0;
+    //在尾位置求值：若最后一步是过程调用，把它填入 tail 并返回空指针
+    virtual ValuePtr evalTail(EvalEnv& env, TailCall&) {
+        return eval(env);
+    }
+    //常量折叠用：求值结果在分析时已知时返回它
+    virtual std::optional<Folded> folded() const {
+        return std::nullopt;
+    }
+};
+
+//if、cond、let 等控制结构只需实现 evalTail；不在尾位置时，推迟的调用立即执行
+class TailNode : public Node {
+public:
+    ValuePtr eval(EvalEnv& env) final;
+};
+
+//字面量和 quote 的结果
+class ConstantNode : public Node {
+    ValuePtr value;
+public:
+    ConstantNode(ValuePtr value);
+    ValuePtr eval(EvalEnv& env) override;
+    std::optional<Folded> folded() const override;
+};
+
+//小过程的内联版本。顶层定义、函数体只有一个不创建闭包的小表达式的 lambda 会额外分析出这样一份函数体，
+//其中的形参直接读取调用点求出的实参，调用点执行它时不创建帧，也不经过 LambdaValue::apply
+struct InlineBody {
+    NodePtr body;
+    std::vector<SymbolId> globals;//函数体引用的全局名字，调用点据此排除递归
+};
+
+//扁平闭包捕获的一个外层局部变量：name 在创建闭包的环境中的词法地址。
+//boxed 为真时捕获的是它的存储单元（BoxValue），否则是创建闭包时的值
+struct Capture {
+    SymbolId name;
+    std::size_t depth;
+    std::size_t slot;
+    bool boxed;
+};
+
+//把 s-表达式翻译为结点树。
+//分析时维护与运行时帧一一对应的静态作用域（每个 lambda、let 一层），
+//局部变量引用被解析为（层数，槽位）的词法地址，运行时不再按名字逐层查找。
+class Analyzer {
+    struct Scope {
+        std::shared_ptr<FrameLayout> layout;
+        Scope* parent;
+        std::vector<SymbolId> boxed{};//帧创建后才被 define 或会被 set! 改写、又被内层闭包引用的名字，它们的槽位可能存放存储单元
+        std::vector<Capture>* captures = nullptr;//不为空时这是扁平闭包的函数体，外层局部变量通过捕获帧访问
+        bool isBoxed(SymbolId name) const;
+    };
+    struct Address {
+        std::size_t depth;
+        std::size_t slot;
+        bool boxed;
+    };
+    //正在分析的 named let 循环体：对 name 的调用是回到循环开头，求值为以 marker 为过程的尾调用
+    struct Loop {
+        SymbolId name;
+        ValuePtr marker;
+    };
+    Scope* scope = nullptr;
+    std::vector<Loop> loops;
+    bool dynamic;
+    const FrameLayout* inlineParams = nullptr;//分析内联函数体时的形参，它们被解析为调用点的实参
+    bool isLocal(SymbolId name) const;
+    //从 from 开始解析局部变量的词法地址。穿过扁平闭包的边界时把变量加入它的捕获列表
+    std::optional<Address> resolve(SymbolId name, Scope* from);
+public:
+    //dynamic 为真表示分析结果将在某个子环境中执行（eval 内置过程、虚拟机的 Form 指令），
+    //此时作用域之外的名字不一定是全局变量，只能在运行时按名字查找
+    explicit Analyzer(bool dynamic = false) : dynamic{dynamic} {}
+    //常量折叠：对字面量实参调用纯内置过程、测试为常量的 if 和 cond、begin 中无用的常量。
+    //折叠依赖的运算符在运行时被重新定义或遮蔽时，结点退回未折叠的版本。
+    //关闭后（--no-fold）分析结果与未实现折叠时相同，便于比较
+    static inline bool constantFolding = true;
+    //是否处于顶层：作用域之外的名字都是全局变量，此处创建的闭包的环境是全局环境
+    bool topLevel() const {
+        return !scope && !dynamic && !inlineParams;
+    }
+    //闭包是否转换为扁平闭包：只捕获用到的外层局部变量，环境的上级直接是全局环境。
+    //dynamic 模式下作用域之外的名字要在运行时沿环境链查找，闭包必须保留整条链
+    bool flatClosures() const {
+        return !dynamic;
+    }
+    //逃逸分析：执行 body 时是否可能创建捕获当前帧的闭包。
+    //扁平闭包只复制变量，不引用帧；其他情况下的 lambda、过程形式的 define 以及不认识的特殊形式
+    //都保守地视为会捕获。不会捕获的函数体的帧可以复用
+    static bool capturesFrame(const std::vector<ValuePtr>& body, bool flatClosures);
+    //body 中是否出现 eval。eval 在运行时按名字查找外层的局部变量，扁平闭包只复制了用到的变量，
+    //所以这样的 lambda 保留整条环境链
+    static bool usesEval(const std::vector<ValuePtr>& body);
+    //named let 能否原地循环执行：函数体中 name 只作为有 arity 个实参的调用的运算符出现在尾位置，
+    //此时每次调用都是进入下一轮循环，不需要真的创建过程
+    static bool loopsInPlace(SymbolId name, std::size_t arity, const std::vector<ValuePtr>& body);
+    //body 适合内联时分析出内联版本，否则返回空
+    static std::shared_ptr<const InlineBody> makeInline(const FrameLayout& params, const std::vector<ValuePtr>& body);
+    NodePtr analyze(const ValuePtr& expr);
+    std::vector<NodePtr> analyzeList(const std::vector<ValuePtr>& exprs);
+    //(set! name value)：按 name 的词法地址改写绑定，value 是已分析的新值
+    NodePtr analyzeAssignment(SymbolId name, NodePtr value);
+    //在以 layout 为帧布局的新作用域中分析函数体。
+    //函数体顶层（包括顶层 begin 中）的 define 预先分配槽位，使它们之前的引用也能解析。
+    //captures 不为空时函数体属于扁平闭包，分析结束后其中是需要捕获的外层变量
+    std::vector<NodePtr> analyzeBody(const std::vector<ValuePtr>& body, const std::shared_ptr<FrameLayout>& layout,
+                                     std::vector<Capture>* captures = nullptr);
+    //同 analyzeBody，但函数体是名为 name 的循环（已由 loopsInPlace 确认），对 name 的调用分析为回到循环开头
+    std::vector<NodePtr> analyzeLoopBody(const std::vector<ValuePtr>& body, const std::shared_ptr<FrameLayout>& layout,
+                                         SymbolId name, ValuePtr marker);
+    //为当前作用域中的 define 分配槽位；不在任何作用域中时返回空
+    std::optional<std::size_t> defineSlot(SymbolId name);
+    //当前作用域中 name 的槽位是否可能存放存储单元
+    bool isBoxed(SymbolId name) const {
+        return scope && scope->isBoxed(name);
+    }
+    //guards 成立时求值 fast，否则求值 slow；guards 为空时直接返回 fast
+    static NodePtr guarded(NodePtr fast, NodePtr slow, std::vector<FoldGuard> guards);
+    //把 from 中尚未出现的名字并入 into
+    static void mergeGuards(std::vector<FoldGuard>& into, const std::vector<FoldGuard>& from);
+};
+
+//依次求值，返回最后一个结点的值；空序列返回空表
+ValuePtr evalSequence(const std::vector<NodePtr>& nodes, EvalEnv& env);
+//同上，但最后一个结点在尾位置求值
+ValuePtr evalSequenceTail(const std::vector<NodePtr>& nodes, EvalEnv& env, TailCall& tail);
+
+#endif
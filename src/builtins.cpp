@@ -1,15 +1,16 @@
 #include "./builtins.h"
+#include "./memo.h"
 #include <iostream>
 #include <algorithm>
 #include <iterator>
 #include <cmath>
 
-void checkNum(const std::vector<ValuePtr>& params, int expectedNum) {
+void checkNum(std::span<const ValuePtr> params, int expectedNum) {
     if (params.size() != expectedNum) {
         throw LispError("Incorrect number of arguments.");
     }
 }
-void checkParams(const std::vector<ValuePtr>& params, int expectedNum, Type expectedType) {
+void checkParams(std::span<const ValuePtr> params, int expectedNum, Type expectedType) {
     checkNum(params, expectedNum);
     for (const auto& param : params) {
         if (param->getType() != expectedType) {
@@ -19,79 +20,79 @@ void checkParams(const std::vector<ValuePtr>& params, int expectedNum, Type expe
 }
 
 
-ValuePtr add(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr add(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, params.size(), Type::Number);
     double result = 0;
     for (const auto& i : params) {
         result += i->asNumber();
     }
-    return std::make_shared<NumericValue>(result);
+    return NumericValue::create(result);
 }
-ValuePtr substract(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr substract(std::span<const ValuePtr> params, EvalEnv& env) {
     if (params.size() == 2) {
         checkParams(params, 2, Type::Number);
-        return std::make_shared<NumericValue>(params[0]->asNumber() - params[1]->asNumber());
+        return NumericValue::create(params[0]->asNumber() - params[1]->asNumber());
     } else if (params.size() == 1) {
         checkParams(params, 1, Type::Number);
-        return std::make_shared<NumericValue>(-params[0]->asNumber());
+        return NumericValue::create(-params[0]->asNumber());
     } else {
         throw LispError("Incorrect number of arguments.");
     }
     
 }
-ValuePtr multiply(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr multiply(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, params.size(), Type::Number);
     double result = 1;
     for (const auto& i : params) {
        result *= i->asNumber();
     }
-    return std::make_shared<NumericValue>(result);
+    return NumericValue::create(result);
 }
-ValuePtr divide(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr divide(std::span<const ValuePtr> params, EvalEnv& env) {
     if (params.size() == 1) {
         checkParams(params, 1, Type::Number);
-        return std::make_shared<NumericValue>(1 / params[0]->asNumber());
+        return NumericValue::create(1 / params[0]->asNumber());
     } else if (params.size() == 2) {
         checkParams(params, 2, Type::Number);
         if (params[1]->asNumber() == 0) {
             throw LispError("divided by zero");
         }
-        return std::make_shared<NumericValue>(params[0]->asNumber() / params[1]->asNumber());
+        return NumericValue::create(params[0]->asNumber() / params[1]->asNumber());
     } else {
         throw LispError("1 or 2 arguments expected but " + std::to_string(params.size()) + " were given in \"/\"");
     }
 }
-ValuePtr absolute(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr absolute(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, 1, Type::Number);
     auto val = params[0]->asNumber();
-    return val >= 0?  std::make_shared<NumericValue>(val) : std::make_shared<NumericValue>(-val);
+    return val >= 0?  NumericValue::create(val) : NumericValue::create(-val);
 }
-ValuePtr expt(const std::vector<ValuePtr>& params, EvalEnv& env) { //不支持复数
+ValuePtr expt(std::span<const ValuePtr> params, EvalEnv& env) { //不支持复数
     checkParams(params, 2, Type::Number);
     if (params[0]->asNumber() == 0 && params[1]->asNumber() == 0) {
         throw LispError("0 ^ 0 is undefined");
     } else {
-        return std::make_shared<NumericValue>(std::pow(params[0]->asNumber(), params[1]->asNumber()));
+        return NumericValue::create(std::pow(params[0]->asNumber(), params[1]->asNumber()));
     }
 }
-ValuePtr quotient(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr quotient(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, 2, Type::Number);
     double val = params[0]->asNumber() / params[1]->asNumber();
-    return std::make_shared<NumericValue>(int(val));
+    return NumericValue::create(int(val));
 }
-ValuePtr modulo(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr modulo(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, 2, Type::Number);
     double x = params[0]->asNumber();
     double y = params[1]->asNumber();
     if (y == 0) {
         throw LispError("divided by zero");
     } else if (x * y >= 0) {
-        return std::make_shared<NumericValue>(remainder(x, y));
+        return NumericValue::create(remainder(x, y));
     } else {
-        return std::make_shared<NumericValue>(y + remainder(x, y));
+        return NumericValue::create(y + remainder(x, y));
     }
 }
-ValuePtr remain(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr remain(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, 2, Type::Number);
     double x = params[0]->asNumber();
     double y = params[1]->asNumber();
@@ -103,79 +104,107 @@ ValuePtr remain(const std::vector<ValuePtr>& params, EvalEnv& env) {
             if (x > 0) rem += abs(y);
             else rem -= abs(y);
         }
-        return std::make_shared<NumericValue>(rem);
+        return NumericValue::create(rem);
     }
 }
 
-ValuePtr equivalent(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr equivalent(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, 2, Type::Number);
-    return std::make_shared<BooleanValue>(params[0]->asNumber() == params[1]->asNumber());
+    return BooleanValue::create(params[0]->asNumber() == params[1]->asNumber());
 }
-ValuePtr smaller(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr smaller(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, 2, Type::Number);
-    return std::make_shared<BooleanValue>(params[0]->asNumber() < params[1]->asNumber());
+    return BooleanValue::create(params[0]->asNumber() < params[1]->asNumber());
 }
-ValuePtr greater(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr greater(std::span<const ValuePtr> params, EvalEnv& env) {
     // 现在你可以在booleanValue上使用逻辑运算符了
-    auto small = std::dynamic_pointer_cast<BooleanValue>(smaller(params, env));
-    auto equal = std::dynamic_pointer_cast<BooleanValue>(equivalent(params, env));
-    return std::make_shared<BooleanValue>(!(*small || *equal));
+    auto small = std::static_pointer_cast<BooleanValue>(smaller(params, env));
+    auto equal = std::static_pointer_cast<BooleanValue>(equivalent(params, env));
+    return BooleanValue::create(!(*small || *equal));
 }
-ValuePtr greater_eq(const std::vector<ValuePtr>& params, EvalEnv& env) {
-    auto small = std::dynamic_pointer_cast<BooleanValue>(smaller(params, env));
-    return std::make_shared<BooleanValue>(!(*small));
+ValuePtr greater_eq(std::span<const ValuePtr> params, EvalEnv& env) {
+    auto small = std::static_pointer_cast<BooleanValue>(smaller(params, env));
+    return BooleanValue::create(!(*small));
 }
-ValuePtr smaller_eq(const std::vector<ValuePtr>& params, EvalEnv& env) {
-    auto great = std::dynamic_pointer_cast<BooleanValue>(greater(params, env));
-    return std::make_shared<BooleanValue>(!(*great));
+ValuePtr smaller_eq(std::span<const ValuePtr> params, EvalEnv& env) {
+    auto great = std::static_pointer_cast<BooleanValue>(greater(params, env));
+    return BooleanValue::create(!(*great));
 }
 
 
-ValuePtr print(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr print(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 1);
     std::cout << params[0]->toString() << '\n';
-    return std::make_shared<NilValue>();
+    return NilValue::create();
 }
-ValuePtr newline(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr newline(std::span<const ValuePtr> params, EvalEnv& env) {
     //向 标准输出 输出操作系统定义的换行符序列。
     //返回值：未定义；建议空表。
     checkNum(params, 0);
     std::cout << '\n';
-    return std::make_shared<NilValue>();
+    return NilValue::create();
 }
-ValuePtr display(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr display(std::span<const ValuePtr> params, EvalEnv& env) {
     //( display val )
     //若 val 是字符串类型数据，则将字符串内容通过 标准输出 输出；
     //否则输出 val 的外部表示，实现可以在外部表示前添加单引号 '。
     //返回值：未定义；建议空表。
     checkNum(params, 1);
-    if (auto string = std::dynamic_pointer_cast<StringValue>(params[0])) {
-        std::cout << string->getVal();
+    if (params[0]->getType() == Type::String) {
+        std::cout << std::static_pointer_cast<StringValue>(params[0])->getVal();
     } else {
         std::cout << params[0]->toString();
     }
-    return std::make_shared<NilValue>();
+    return NilValue::create();
 }
-ValuePtr displayLn(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr displayLn(std::span<const ValuePtr> params, EvalEnv& env) {
     display(params, env);
     std::cout << '\n';
-    return std::make_shared<NilValue>();
+    return NilValue::create();
 }
 
 
-ValuePtr apply(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr apply(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 2);
     return env.apply(params[0], params[1]->toVector());
 }
-ValuePtr eval(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr eval(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 1);
     return env.eval(params[0]);
 }
-ValuePtr error(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr memoize(std::span<const ValuePtr> params, EvalEnv& env) {
+    //( memoize proc [limit] )
+    //返回值：与 proc 行为相同、按实参（用 equal? 比较）缓存结果的过程；给出 limit 时最多缓存 limit 个结果，淘汰最久未用的。
+    if (params[0]->getType() != Type::Lambda) {
+        throw LispError("lambda expected in \"memoize\"");
+    }
+    std::size_t limit = 0;
+    if (params.size() == 2) {
+        double value = params[1]->isNumber() ? params[1]->asNumber() : 0;
+        if (value < 1 || value != int(value)) {
+            throw LispError("positive integer expected in \"memoize\"");
+        }
+        limit = static_cast<std::size_t>(value);
+    }
+    return static_cast<LambdaValue&>(*params[0]).memoized(limit);
+}
+ValuePtr memoStats(std::span<const ValuePtr> params, EvalEnv& env) {
+    //( memo-stats proc )
+    //返回值：列表 (命中次数 未命中次数 缓存的结果个数)。
+    checkNum(params, 1);
+    auto table = params[0]->getType() == Type::Lambda ? static_cast<LambdaValue&>(*params[0]).memoTable() : nullptr;
+    if (!table) {
+        throw LispError("memoized procedure expected in \"memo-stats\"");
+    }
+    return PairValue::create(NumericValue::create(table->getHits()),
+           PairValue::create(NumericValue::create(table->getMisses()),
+           PairValue::create(NumericValue::create(table->size()), NilValue::create())));
+}
+ValuePtr error(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 1);
     throw LispError(params[0]->toString());
 }
-ValuePtr exitFunc(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr exitFunc(std::span<const ValuePtr> params, EvalEnv& env) {
     if (params.size() == 0) {
         std::exit(0);
     }
@@ -187,45 +216,47 @@ ValuePtr exitFunc(const std::vector<ValuePtr>& params, EvalEnv& env) {
     }
 }
 
-template <typename T>
-ValuePtr isType(const std::vector<ValuePtr>& params, EvalEnv& env) {
+template <Type T>
+ValuePtr isType(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 1);
-    return std::make_shared<BooleanValue>(typeid(*params[0]) == typeid(T));
+    return BooleanValue::create(params[0]->getType() == T);
 }
-ValuePtr isInteger(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr isInteger(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 1);
-    return std::make_shared<BooleanValue>((typeid(*params[0]) == typeid(NumericValue) && params[0]->asNumber() == int(params[0]->asNumber())));
+    return BooleanValue::create((params[0]->isNumber() && params[0]->asNumber() == int(params[0]->asNumber())));
 }
-ValuePtr isList(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr isList(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 1);
-    return std::make_shared<BooleanValue>(params[0]->isList());
+    return BooleanValue::create(params[0]->isList());
 }
-ValuePtr isProc(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr isProc(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 1);
-    return std::make_shared<BooleanValue>((typeid(*params[0]) == typeid(BuiltinProcValue) || typeid(*params[0]) == typeid(LambdaValue)));
+    return BooleanValue::create(params[0]->getType() == Type::BuiltinProc || params[0]->getType() == Type::Lambda);
 }
-ValuePtr isAtom(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr isAtom(std::span<const ValuePtr> params, EvalEnv& env) {
     //返回值：若 arg 为布尔类型、数类型、字符串类型、符号类型或空表类型的值，则返回 #t；否则返回 #f。
-    auto boolean = std::dynamic_pointer_cast<BooleanValue>(isType<BooleanValue>(params, env));
-    auto num = std::dynamic_pointer_cast<BooleanValue>(isType<NumericValue>(params, env));
-    auto nil = std::dynamic_pointer_cast<BooleanValue>(isType<NilValue>(params, env));
-    auto string = std::dynamic_pointer_cast<BooleanValue>(isType<StringValue>(params, env));
-    auto symbol = std::dynamic_pointer_cast<BooleanValue>(isType<SymbolValue>(params, env));
-    return std::make_shared<BooleanValue>(*boolean || *num || *nil || *string || *symbol);
+    auto boolean = std::static_pointer_cast<BooleanValue>(isType<Type::Boolean>(params, env));
+    auto num = std::static_pointer_cast<BooleanValue>(isType<Type::Number>(params, env));
+    auto nil = std::static_pointer_cast<BooleanValue>(isType<Type::Nil>(params, env));
+    auto string = std::static_pointer_cast<BooleanValue>(isType<Type::String>(params, env));
+    auto symbol = std::static_pointer_cast<BooleanValue>(isType<Type::Symbol>(params, env));
+    return BooleanValue::create(*boolean || *num || *nil || *string || *symbol);
 
 }
 
-ValuePtr vector2list(const std::vector<ValuePtr>& params, EvalEnv& env) {
-    if (!params.size()) return std::make_shared<NilValue>();
-    std::vector<ValuePtr> n_params;
-    n_params.insert(n_params.end(), params.begin() + 1, params.end());
-    return std::make_shared<PairValue>(params[0], vector2list(n_params, env));
+ValuePtr vector2list(std::span<const ValuePtr> params, EvalEnv& env) {
+    //从尾部向前逐个 cons，线性时间且相邻的对子在内存池里紧挨着
+    ValuePtr list = NilValue::create();
+    for (auto it = params.rbegin(); it != params.rend(); ++it) {
+        list = PairValue::create(*it, list);
+    }
+    return list;
 }
-ValuePtr appendFunc(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr appendFunc(std::span<const ValuePtr> params, EvalEnv& env) {
     //将 list 内的元素按顺序拼接为一个新的列表。
     //返回值：拼接后的列表；实参个数为零时返回空表。
     //(append '(1 2 3) '(a b c) '(foo bar baz)) ⇒ '(1 2 3 a b c foo bar baz)
-    if (!params.size()) return std::make_shared<NilValue>();
+    if (!params.size()) return NilValue::create();
     
     std::vector<ValuePtr> res;
     for (int i = 0; i < params.size(); ++i) {
@@ -239,154 +270,337 @@ ValuePtr appendFunc(const std::vector<ValuePtr>& params, EvalEnv& env) {
     }
     return vector2list(res, env);
 }
-ValuePtr car(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr car(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, 1, Type::Pair);
-    auto pair = std::dynamic_pointer_cast<PairValue>(params[0]);
+    auto pair = std::static_pointer_cast<PairValue>(params[0]);
     return pair->getCar();
 }
-ValuePtr cdr(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr cdr(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, 1, Type::Pair);
-    auto pair = std::dynamic_pointer_cast<PairValue>(params[0]);
+    auto pair = std::static_pointer_cast<PairValue>(params[0]);
     return pair->getCdr();
 }
-ValuePtr cons(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr cons(std::span<const ValuePtr> params, EvalEnv& env) {
     //返回值：以 first 为左半部分，rest 为右半部分的对子类型数据。
     checkNum(params, 2);
-    return std::make_shared<PairValue>(params[0], params[1]);   
+    return PairValue::create(params[0], params[1]);   
 }
-ValuePtr length(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr length(std::span<const ValuePtr> params, EvalEnv& env) {
     //返回值：非负整数，list 的元素个数。
     checkNum(params, 1);
     if (!params[0]->isList()) {
         throw LispError("list expected in \"length\"");
     } else {
         auto v = params[0]->toVector();
-        return std::make_shared<NumericValue>(v.size());
+        return NumericValue::create(v.size());
     }
 }
-ValuePtr map(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr map(std::span<const ValuePtr> params, EvalEnv& env) {
     //( map proc list )
     //proc 应能接受一个实参。返回值：一个新列表，其中的每个元素都是 list 中对应位置元素被 proc 作用后的结果。
     checkNum(params, 2);
     std::vector<ValuePtr> result;
     std::ranges::transform(params[1]->toVector(),//将list转化成vector
                            std::back_inserter(result),
-                           [&](ValuePtr v) { return env.apply(params[0], std::vector<ValuePtr>{v}); });//vector中每个实参apply proc
+                           [&](const ValuePtr& v) { return env.apply(params[0], std::span(&v, 1)); });//vector中每个实参apply proc
     return vector2list(result, env);//转化回list
     
 }
-ValuePtr filter(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr filter(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 2);
     std::vector<ValuePtr> result;
     auto vec = params[1]->toVector();
     std::copy_if(vec.begin(), vec.end(), std::back_inserter(result), 
-                        [&](ValuePtr v) { return !env.apply(params[0], std::vector<ValuePtr>{v})->isFalse(); });
+                        [&](const ValuePtr& v) { return !env.apply(params[0], std::span(&v, 1))->isFalse(); });
     return vector2list(result, env);
     
 }
-ValuePtr reduce(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr reduce(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 2);
     if (!params[1]->isList()) {
         throw LispError("the second argument in \"reduce\" should be a list");
-    } else if (typeid(*params[1]) == typeid(NilValue)) {
+    } else if (params[1]->isNil()) {
         throw LispError("the second argument in \"reduce\" cannot be Nil");
-    } else if (length(std::vector<ValuePtr>{params[1]}, env)->asNumber() == 1) {
-        auto pair = std::dynamic_pointer_cast<PairValue>(params[1]);
+    } else if (static_cast<PairValue&>(*params[1]).getCdr()->isNil()) {
+        auto pair = std::static_pointer_cast<PairValue>(params[1]);
         return pair->getCar();
     } else {
-         auto pair = std::dynamic_pointer_cast<PairValue>(params[1]);
-         auto car = pair->getCar();
-         auto cdr = pair->getCdr();
-         auto proc = params[0];
-         return env.apply(proc, std::vector<ValuePtr>{car, reduce(std::vector<ValuePtr>{params[0], cdr}, env)});
+         auto pair = std::static_pointer_cast<PairValue>(params[1]);
+         const ValuePtr rest[] = {params[0], pair->getCdr()};
+         const ValuePtr args[] = {pair->getCar(), reduce(rest, env)};
+         return env.apply(params[0], args);
     }
 
 }
 
+//流是 car 为元素、cdr 为承诺的对子，空流为空表。下面的过程也接受承诺形式的流和普通列表
+ValuePtr forceValue(const ValuePtr& value, EvalEnv& env) {
+    if (value->getType() == Type::Promise) {
+        return static_cast<PromiseValue&>(*value).force(env);
+    }
+    return value;
+}
+PairValue& streamPair(const ValuePtr& stream, const char* name) {
+    if (stream->getType() != Type::Pair) {
+        throw LispError(std::string("non-empty stream expected in \"") + name + '"');
+    }
+    return static_cast<PairValue&>(*stream);
+}
+ValuePtr force(std::span<const ValuePtr> params, EvalEnv& env) {
+    //( force obj )
+    //返回值：obj 是承诺时为它的值（只求值一次），否则为 obj 本身。
+    checkNum(params, 1);
+    return forceValue(params[0], env);
+}
+ValuePtr streamCar(std::span<const ValuePtr> params, EvalEnv& env) {
+    checkNum(params, 1);
+    return streamPair(forceValue(params[0], env), "stream-car").getCar();
+}
+ValuePtr streamCdr(std::span<const ValuePtr> params, EvalEnv& env) {
+    checkNum(params, 1);
+    return forceValue(streamPair(forceValue(params[0], env), "stream-cdr").getCdr(), env);
+}
+ValuePtr streamMap(std::span<const ValuePtr> params, EvalEnv& env) {
+    //( stream-map proc stream )
+    //返回值：一个新流。只立即计算第一个元素，其余元素在取用时才计算。
+    checkNum(params, 2);
+    static const ValuePtr self = BUILTIN_FUNCS.at(SymbolValue::idOf("stream-map"));
+    auto stream = forceValue(params[1], env);
+    if (stream->isNil()) return stream;
+    auto& pair = streamPair(stream, "stream-map");
+    auto head = pair.getCar();
+    auto value = env.apply(params[0], std::span(&head, 1));
+    return PairValue::create(value, PromiseValue::create(self, {params[0], pair.getCdr()}));
+}
+ValuePtr streamFilter(std::span<const ValuePtr> params, EvalEnv& env) {
+    //( stream-filter pred stream )
+    //返回值：一个新流，由使 pred 为真的元素组成。只向前找到第一个满足的元素。
+    checkNum(params, 2);
+    static const ValuePtr self = BUILTIN_FUNCS.at(SymbolValue::idOf("stream-filter"));
+    auto stream = forceValue(params[1], env);
+    while (!stream->isNil()) {
+        auto& pair = streamPair(stream, "stream-filter");
+        auto head = pair.getCar();
+        if (!env.apply(params[0], std::span(&head, 1))->isFalse()) {
+            return PairValue::create(head, PromiseValue::create(self, {params[0], pair.getCdr()}));
+        }
+        stream = forceValue(pair.getCdr(), env);//跳过的元素不再被引用
+    }
+    return stream;
+}
+ValuePtr streamTake(std::span<const ValuePtr> params, EvalEnv& env) {
+    //( stream-take stream n )
+    //返回值：流的前 n 个元素组成的列表（流较短时为全部元素）。只计算这 n 个元素。
+    checkNum(params, 2);
+    if (!params[1]->isNumber() || params[1]->asNumber() < 0 || params[1]->asNumber() != int(params[1]->asNumber())) {
+        throw LispError("non-negative integer expected in \"stream-take\"");
+    }
+    std::vector<ValuePtr> result;
+    auto stream = params[0];
+    for (int n = int(params[1]->asNumber()); n > 0; --n) {
+        stream = forceValue(stream, env);
+        if (stream->isNil()) break;
+        auto& pair = streamPair(stream, "stream-take");
+        result.push_back(pair.getCar());
+        stream = pair.getCdr();
+    }
+    return vector2list(result, env);
+}
 
-ValuePtr isEqual(const std::vector<ValuePtr>& params, EvalEnv& env) {
+
+ValuePtr isEqual(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 2);
-    return std::make_shared<BooleanValue>(params[0]->isEqual(*params[1]));
+    return BooleanValue::create(params[0]->isEqual(*params[1]));
 }
-ValuePtr isEq(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr isEq(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 2);
-    if (typeid(*params[0]) != typeid(*params[1])) return std::make_shared<BooleanValue>(false);
-    auto n_params = std::vector<ValuePtr>{params[0]};
-    if (!(*std::dynamic_pointer_cast<BooleanValue>(isType<StringValue>(n_params, env))) && *std::dynamic_pointer_cast<BooleanValue>(isAtom(n_params, env))) {
-        return std::make_shared<BooleanValue>(params[0]->isEqual(*params[1]));
+    if (params[0]->getType() != params[1]->getType()) return BooleanValue::create(false);
+    auto n_params = params.first(1);
+    if (!(*std::static_pointer_cast<BooleanValue>(isType<Type::String>(n_params, env))) && *std::static_pointer_cast<BooleanValue>(isAtom(n_params, env))) {
+        return BooleanValue::create(params[0]->isEqual(*params[1]));
     } else {
-        return std::make_shared<BooleanValue>(params[0] == params[1]);
+        return BooleanValue::create(params[0] == params[1]);
     }
 }
-ValuePtr notFunc(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr notFunc(std::span<const ValuePtr> params, EvalEnv& env) {
     checkNum(params, 1);
-    return std::make_shared<BooleanValue>(params[0]->isFalse());
+    return BooleanValue::create(params[0]->isFalse());
 }
-ValuePtr isOdd(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr isOdd(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, 1, Type::Number);
     if (!(params[0]->asNumber() == int(params[0]->asNumber()))){
         throw LispError("integer expected");
     } else {
-        return std::make_shared<BooleanValue>(int(params[0]->asNumber()) % 2);
+        return BooleanValue::create(int(params[0]->asNumber()) % 2);
     } 
 }
-ValuePtr isEven(const std::vector<ValuePtr>& params, EvalEnv& env) {
-    auto odd = std::dynamic_pointer_cast<BooleanValue>(isOdd(params, env));
-    return std::make_shared<BooleanValue>(!*odd);
+ValuePtr isEven(std::span<const ValuePtr> params, EvalEnv& env) {
+    auto odd = std::static_pointer_cast<BooleanValue>(isOdd(params, env));
+    return BooleanValue::create(!*odd);
 }
-ValuePtr isZero(const std::vector<ValuePtr>& params, EvalEnv& env) {
+ValuePtr isZero(std::span<const ValuePtr> params, EvalEnv& env) {
     checkParams(params, 1, Type::Number);
-    return std::make_shared<BooleanValue>(params[0]->asNumber() == 0); 
+    return BooleanValue::create(params[0]->asNumber() == 0); 
 }
 
 
-const std::unordered_map<std::string, std::shared_ptr<BuiltinProcValue>> BUILTIN_FUNCS = {
-    {"+", std::make_shared<BuiltinProcValue>(&add)},
-    {"print", std::make_shared<BuiltinProcValue>(&print)},
-    {"-", std::make_shared<BuiltinProcValue>(&substract)}, 
-    {"*", std::make_shared<BuiltinProcValue>(&multiply)}, 
-    {">", std::make_shared<BuiltinProcValue>(&greater)}, 
-    {"apply", std::make_shared<BuiltinProcValue>(&apply)}, 
-    {"display", std::make_shared<BuiltinProcValue>(&display)}, 
-    {"displayln", std::make_shared<BuiltinProcValue>(&displayLn)},
-    {"error", std::make_shared<BuiltinProcValue>(&error)}, 
-    {"eval", std::make_shared<BuiltinProcValue>(&eval)}, 
-    {"exit", std::make_shared<BuiltinProcValue>(&exitFunc)}, 
-    {"newline", std::make_shared<BuiltinProcValue>(&newline)}, 
-    {"atom?", std::make_shared<BuiltinProcValue>(&isAtom)}, 
-    {"boolean?", std::make_shared<BuiltinProcValue>(&isType<BooleanValue>)}, 
-    {"integer?", std::make_shared<BuiltinProcValue>(&isInteger)}, 
-    {"list?", std::make_shared<BuiltinProcValue>(&isList)}, 
-    {"number?", std::make_shared<BuiltinProcValue>(&isType<NumericValue>)},
-    {"null?", std::make_shared<BuiltinProcValue>(&isType<NilValue>)},
-    {"pair?", std::make_shared<BuiltinProcValue>(&isType<PairValue>)},
-    {"procedure?", std::make_shared<BuiltinProcValue>(&isProc)},
-    {"string?", std::make_shared<BuiltinProcValue>(&isType<StringValue>)},
-    {"symbol?", std::make_shared<BuiltinProcValue>(&isType<SymbolValue>)},
-    {"append", std::make_shared<BuiltinProcValue>(&appendFunc)},
-    {"car", std::make_shared<BuiltinProcValue>(&car)},
-    {"cdr", std::make_shared<BuiltinProcValue>(&cdr)},
-    {"cons", std::make_shared<BuiltinProcValue>(&cons)},
-    {"length", std::make_shared<BuiltinProcValue>(&length)},
-    {"list", std::make_shared<BuiltinProcValue>(&vector2list)},
-    {"map", std::make_shared<BuiltinProcValue>(&map)},
-    {"filter", std::make_shared<BuiltinProcValue>(&filter)},
-    {"reduce", std::make_shared<BuiltinProcValue>(&reduce)},
-    {"/", std::make_shared<BuiltinProcValue>(&divide)},
-    {"abs", std::make_shared<BuiltinProcValue>(&absolute)},
-    {"expt", std::make_shared<BuiltinProcValue>(&expt)},//不支持复数
-    {"quotient", std::make_shared<BuiltinProcValue>(&quotient)},
-    {"modulo", std::make_shared<BuiltinProcValue>(&modulo)},
-    {"remainder", std::make_shared<BuiltinProcValue>(&remain)},
-    {"eq?", std::make_shared<BuiltinProcValue>(&isEq)},
-    {"equal?", std::make_shared<BuiltinProcValue>(&isEqual)},
-    {"not", std::make_shared<BuiltinProcValue>(&notFunc)},
-    {"<", std::make_shared<BuiltinProcValue>(&smaller)},
-    {"<=", std::make_shared<BuiltinProcValue>(&smaller_eq)},
-    {"=", std::make_shared<BuiltinProcValue>(&equivalent)},
-    {">=", std::make_shared<BuiltinProcValue>(&greater_eq)},
-    {"odd?", std::make_shared<BuiltinProcValue>(&isOdd)},
-    {"even?", std::make_shared<BuiltinProcValue>(&isEven)},
-    {"zero?", std::make_shared<BuiltinProcValue>(&isZero)},
+//常用过程的定长入口：实参直接以引用传入，不经过 span 和个数检查（个数已由 BuiltinProcValue::call 确认）
+double numberArg(const ValuePtr& value) {
+    if (value->getType() != Type::Number) {
+        throw LispError("Incorrect type of argument.");
+    }
+    return value->asNumber();
+}
+ValuePtr add2(const ValuePtr& x, const ValuePtr& y, EvalEnv& env) {
+    return NumericValue::create(numberArg(x) + numberArg(y));
+}
+ValuePtr substract2(const ValuePtr& x, const ValuePtr& y, EvalEnv& env) {
+    return NumericValue::create(numberArg(x) - numberArg(y));
+}
+ValuePtr negate1(const ValuePtr& x, EvalEnv& env) {
+    return NumericValue::create(-numberArg(x));
+}
+ValuePtr multiply2(const ValuePtr& x, const ValuePtr& y, EvalEnv& env) {
+    return NumericValue::create(numberArg(x) * numberArg(y));
+}
+ValuePtr equivalent2(const ValuePtr& x, const ValuePtr& y, EvalEnv& env) {
+    return BooleanValue::create(numberArg(x) == numberArg(y));
+}
+ValuePtr smaller2(const ValuePtr& x, const ValuePtr& y, EvalEnv& env) {
+    return BooleanValue::create(numberArg(x) < numberArg(y));
+}
+ValuePtr greater2(const ValuePtr& x, const ValuePtr& y, EvalEnv& env) {
+    return BooleanValue::create(numberArg(x) > numberArg(y));
+}
+ValuePtr smallerEq2(const ValuePtr& x, const ValuePtr& y, EvalEnv& env) {
+    return BooleanValue::create(numberArg(x) <= numberArg(y));
+}
+ValuePtr greaterEq2(const ValuePtr& x, const ValuePtr& y, EvalEnv& env) {
+    return BooleanValue::create(numberArg(x) >= numberArg(y));
+}
+ValuePtr cons2(const ValuePtr& x, const ValuePtr& y, EvalEnv& env) {
+    return PairValue::create(x, y);
+}
+ValuePtr car1(const ValuePtr& x, EvalEnv& env) {
+    if (x->getType() != Type::Pair) {
+        throw LispError("Incorrect type of argument.");
+    }
+    return static_cast<PairValue&>(*x).getCar();
+}
+ValuePtr cdr1(const ValuePtr& x, EvalEnv& env) {
+    if (x->getType() != Type::Pair) {
+        throw LispError("Incorrect type of argument.");
+    }
+    return static_cast<PairValue&>(*x).getCdr();
+}
+ValuePtr not1(const ValuePtr& x, EvalEnv& env) {
+    return BooleanValue::create(x->isFalse());
+}
+template <Type T>
+ValuePtr isType1(const ValuePtr& x, EvalEnv& env) {
+    return BooleanValue::create(x->getType() == T);
+}
+ValuePtr isZero1(const ValuePtr& x, EvalEnv& env) {
+    return BooleanValue::create(numberArg(x) == 0);
+}
+
+
+const std::unordered_map<SymbolId, std::shared_ptr<BuiltinProcValue>> BUILTIN_FUNCS = {
+    {SymbolValue::idOf("+"), std::make_shared<BuiltinProcValue>(&add, 0, BuiltinProcValue::VARIADIC, nullptr, &add2)},
+    {SymbolValue::idOf("print"), std::make_shared<BuiltinProcValue>(&print, 1, 1)},
+    {SymbolValue::idOf("-"), std::make_shared<BuiltinProcValue>(&substract, 1, 2, &negate1, &substract2)}, 
+    {SymbolValue::idOf("*"), std::make_shared<BuiltinProcValue>(&multiply, 0, BuiltinProcValue::VARIADIC, nullptr, &multiply2)}, 
+    {SymbolValue::idOf(">"), std::make_shared<BuiltinProcValue>(&greater, 2, 2, nullptr, &greater2)}, 
+    {SymbolValue::idOf("apply"), std::make_shared<BuiltinProcValue>(&apply, 2, 2)}, 
+    {SymbolValue::idOf("display"), std::make_shared<BuiltinProcValue>(&display, 1, 1)}, 
+    {SymbolValue::idOf("displayln"), std::make_shared<BuiltinProcValue>(&displayLn, 1, 1)},
+    {SymbolValue::idOf("memoize"), std::make_shared<BuiltinProcValue>(&memoize, 1, 2)},
+    {SymbolValue::idOf("memo-stats"), std::make_shared<BuiltinProcValue>(&memoStats, 1, 1)},
+    {SymbolValue::idOf("error"), std::make_shared<BuiltinProcValue>(&error, 1, 1)}, 
+    {SymbolValue::idOf("eval"), std::make_shared<BuiltinProcValue>(&eval, 1, 1)}, 
+    {SymbolValue::idOf("exit"), std::make_shared<BuiltinProcValue>(&exitFunc, 0, 1)}, 
+    {SymbolValue::idOf("newline"), std::make_shared<BuiltinProcValue>(&newline, 0, 0)}, 
+    {SymbolValue::idOf("atom?"), std::make_shared<BuiltinProcValue>(&isAtom, 1, 1)}, 
+    {SymbolValue::idOf("boolean?"), std::make_shared<BuiltinProcValue>(&isType<Type::Boolean>, 1, 1)}, 
+    {SymbolValue::idOf("integer?"), std::make_shared<BuiltinProcValue>(&isInteger, 1, 1)}, 
+    {SymbolValue::idOf("list?"), std::make_shared<BuiltinProcValue>(&isList, 1, 1)}, 
+    {SymbolValue::idOf("number?"), std::make_shared<BuiltinProcValue>(&isType<Type::Number>, 1, 1)},
+    {SymbolValue::idOf("null?"), std::make_shared<BuiltinProcValue>(&isType<Type::Nil>, 1, 1, &isType1<Type::Nil>)},
+    {SymbolValue::idOf("pair?"), std::make_shared<BuiltinProcValue>(&isType<Type::Pair>, 1, 1, &isType1<Type::Pair>)},
+    {SymbolValue::idOf("procedure?"), std::make_shared<BuiltinProcValue>(&isProc, 1, 1)},
+    {SymbolValue::idOf("string?"), std::make_shared<BuiltinProcValue>(&isType<Type::String>, 1, 1)},
+    {SymbolValue::idOf("symbol?"), std::make_shared<BuiltinProcValue>(&isType<Type::Symbol>, 1, 1)},
+    {SymbolValue::idOf("append"), std::make_shared<BuiltinProcValue>(&appendFunc, 0, BuiltinProcValue::VARIADIC)},
+    {SymbolValue::idOf("car"), std::make_shared<BuiltinProcValue>(&car, 1, 1, &car1)},
+    {SymbolValue::idOf("cdr"), std::make_shared<BuiltinProcValue>(&cdr, 1, 1, &cdr1)},
+    {SymbolValue::idOf("cons"), std::make_shared<BuiltinProcValue>(&cons, 2, 2, nullptr, &cons2)},
+    {SymbolValue::idOf("length"), std::make_shared<BuiltinProcValue>(&length, 1, 1)},
+    {SymbolValue::idOf("list"), std::make_shared<BuiltinProcValue>(&vector2list, 0, BuiltinProcValue::VARIADIC)},
+    {SymbolValue::idOf("map"), std::make_shared<BuiltinProcValue>(&map, 2, 2)},
+    {SymbolValue::idOf("filter"), std::make_shared<BuiltinProcValue>(&filter, 2, 2)},
+    {SymbolValue::idOf("reduce"), std::make_shared<BuiltinProcValue>(&reduce, 2, 2)},
+    {SymbolValue::idOf("force"), std::make_shared<BuiltinProcValue>(&force, 1, 1)},
+    {SymbolValue::idOf("stream-car"), std::make_shared<BuiltinProcValue>(&streamCar, 1, 1)},
+    {SymbolValue::idOf("stream-cdr"), std::make_shared<BuiltinProcValue>(&streamCdr, 1, 1)},
+    {SymbolValue::idOf("stream-map"), std::make_shared<BuiltinProcValue>(&streamMap, 2, 2)},
+    {SymbolValue::idOf("stream-filter"), std::make_shared<BuiltinProcValue>(&streamFilter, 2, 2)},
+    {SymbolValue::idOf("stream-take"), std::make_shared<BuiltinProcValue>(&streamTake, 2, 2)},
+    {SymbolValue::idOf("/"), std::make_shared<BuiltinProcValue>(&divide, 0, BuiltinProcValue::VARIADIC)},
+    {SymbolValue::idOf("abs"), std::make_shared<BuiltinProcValue>(&absolute, 1, 1)},
+    {SymbolValue::idOf("expt"), std::make_shared<BuiltinProcValue>(&expt, 2, 2)},//不支持复数
+    {SymbolValue::idOf("quotient"), std::make_shared<BuiltinProcValue>(&quotient, 2, 2)},
+    {SymbolValue::idOf("modulo"), std::make_shared<BuiltinProcValue>(&modulo, 2, 2)},
+    {SymbolValue::idOf("remainder"), std::make_shared<BuiltinProcValue>(&remain, 2, 2)},
+    {SymbolValue::idOf("eq?"), std::make_shared<BuiltinProcValue>(&isEq, 2, 2)},
+    {SymbolValue::idOf("equal?"), std::make_shared<BuiltinProcValue>(&isEqual, 2, 2)},
+    {SymbolValue::idOf("not"), std::make_shared<BuiltinProcValue>(&notFunc, 1, 1, &not1)},
+    {SymbolValue::idOf("<"), std::make_shared<BuiltinProcValue>(&smaller, 2, 2, nullptr, &smaller2)},
+    {SymbolValue::idOf("<="), std::make_shared<BuiltinProcValue>(&smaller_eq, 2, 2, nullptr, &smallerEq2)},
+    {SymbolValue::idOf("="), std::make_shared<BuiltinProcValue>(&equivalent, 2, 2, nullptr, &equivalent2)},
+    {SymbolValue::idOf(">="), std::make_shared<BuiltinProcValue>(&greater_eq, 2, 2, nullptr, &greaterEq2)},
+    {SymbolValue::idOf("odd?"), std::make_shared<BuiltinProcValue>(&isOdd, 1, 1)},
+    {SymbolValue::idOf("even?"), std::make_shared<BuiltinProcValue>(&isEven, 1, 1)},
+    {SymbolValue::idOf("zero?"), std::make_shared<BuiltinProcValue>(&isZero, 1, 1, &isZero1)},
     // 其他内置函数
-};
\ No newline at end of file
+};
+
+std::optional<PrimitiveInfo> findPrimitive(SymbolId name) {
+    static const std::unordered_map<SymbolId, PrimitiveInfo> primitives = [] {
+        std::unordered_map<SymbolId, PrimitiveInfo> table;
+        auto add = [&](const char* symbol, Primitive op) {
+            auto id = SymbolValue::idOf(symbol);
+            table.emplace(id, PrimitiveInfo{op, BUILTIN_FUNCS.at(id).get()});
+        };
+        add("+", Primitive::Add);
+        add("-", Primitive::Subtract);
+        add("*", Primitive::Multiply);
+        add("<", Primitive::Less);
+        add(">", Primitive::Greater);
+        add("=", Primitive::Equal);
+        add("<=", Primitive::LessEq);
+        add(">=", Primitive::GreaterEq);
+        return table;
+    }();
+    if (auto it = primitives.find(name); it != primitives.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+std::optional<PrimitiveFold> findFoldable(SymbolId name) {
+    static const std::unordered_map<SymbolId, const Value*> pure = [] {
+        std::unordered_map<SymbolId, const Value*> table;
+        for (auto symbol : {"+", "-", "*", "/", "abs", "expt", "quotient", "modulo", "remainder",
+                            "<", ">", "=", "<=", ">=", "not", "odd?", "even?", "zero?",
+                            "number?", "integer?", "boolean?", "string?", "symbol?", "null?", "pair?", "atom?", "list?",
+                            "procedure?", "eq?", "equal?"}) {
+            auto id = SymbolValue::idOf(symbol);
+            table.emplace(id, BUILTIN_FUNCS.at(id).get());
+        }
+        return table;
+    }();
+    if (auto it = pure.find(name); it != pure.end()) {
+        return PrimitiveFold{name, it->second};
+    }
+    return std::nullopt;
+}
@@ -4,13 +4,42 @@
 #include <memory>
 #include "./error.h"
 #include "./value.h"
+#include <optional>
 #include <unordered_map>
 
 using ValuePtr = std::shared_ptr<Value>;
-using BuiltinFuncType = ValuePtr(const std::vector<ValuePtr>&);
 
 //builtinfuncs的具体实现和map在builtin.cpp中
-extern const std::unordered_map<std::string, std::shared_ptr<BuiltinProcValue>> BUILTIN_FUNCS;
+extern const std::unordered_map<SymbolId, std::shared_ptr<BuiltinProcValue>> BUILTIN_FUNCS;
 
+//可以在调用点内联计算的二元数值过程
+enum class Primitive { Add, Subtract, Multiply, Less, Greater, Equal, LessEq, GreaterEq };
+struct PrimitiveInfo {
+    Primitive op;
+    const Value* builtin;//原来的内置过程，调用点据此判断运算符是否被重新定义
+};
+//name 原本绑定的内置过程可以内联时返回对应的运算
+std::optional<PrimitiveInfo> findPrimitive(SymbolId name);
+//两个实参都是数时的结果，与对应内置过程的定长入口一致
+inline ValuePtr computePrimitive(Primitive op, double x, double y) {
+    switch (op) {
+        case Primitive::Add: return NumericValue::create(x + y);
+        case Primitive::Subtract: return NumericValue::create(x - y);
+        case Primitive::Multiply: return NumericValue::create(x * y);
+        case Primitive::Less: return BooleanValue::create(x < y);
+        case Primitive::Greater: return BooleanValue::create(x > y);
+        case Primitive::Equal: return BooleanValue::create(x == y);
+        case Primitive::LessEq: return BooleanValue::create(x <= y);
+        case Primitive::GreaterEq: return BooleanValue::create(x >= y);
+    }
+    return nullptr;
+}
+
+//无副作用、结果只取决于实参的内置过程，实参都是常量时可以在分析时调用
+struct PrimitiveFold {
+    SymbolId name;
+    const Value* builtin;
+};
+std::optional<PrimitiveFold> findFoldable(SymbolId name);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "./value.h"
+
+//字节码指令。每条指令占一个字，操作数紧随其后，各占一个字。
+//顺序必须与 vm.cpp 中的跳转表一致。
+enum class OpCode : std::int32_t {
+    Const,           //k：压入 constants[k]
+    Load,            //name：在当前环境中查找变量
+    Define,          //name：弹出值并绑定到当前环境，压入空表
+    Set,             //name：弹出值并改写最近的已有绑定，压入空表
+    Pop,             //丢弃栈顶
+    Jump,            //target
+    JumpIfFalse,     //target：弹出条件，为 #f 则跳转
+    JumpIfFalseKeep, //target：栈顶为 #f 则保留并跳转，否则弹出（and）
+    JumpIfTrueKeep,  //target：栈顶不为 #f 则保留并跳转，否则弹出（or、无体的 cond 子句）
+    Closure,         //k：用 prototypes[k] 和当前环境创建闭包
+    Call,            //argc：栈上依次为过程和 argc 个实参
+    TailCall,        //argc：同 Call，但复用当前调用帧
+    Return,          //弹出返回值并回到调用者
+    EnterLet,        //k：弹出 letParams[k].size() 个值，创建子环境并切换过去
+    LeaveLet,        //回到 let 之前的环境
+    Form,            //k：在当前环境中执行分析好的结点 forms[k]（编译器未直接支持的特殊形式）
+    Fail,            //k：以 constants[k] 为消息抛出 LispError
+    Primitive,       //op k：紧接在 Call 2 / TailCall 2 之前。栈上的过程就是 constants[k]
+                     //（原来的内置过程）且两个实参都是数时直接计算并跳过后面的调用指令
+};
+
+struct Chunk;
+
+//lambda 表达式编译后的原型，每次执行 Closure 都据此创建一个闭包
+struct Prototype {
+    FrameLayoutPtr params;
+    std::shared_ptr<const Chunk> chunk;
+};
+
+struct Chunk {
+    std::vector<std::int32_t> code;
+    std::vector<ValuePtr> constants;
+    std::vector<Prototype> prototypes;
+    std::vector<FrameLayoutPtr> letParams;
+    std::vector<NodePtr> forms;
+};
+
+#endif
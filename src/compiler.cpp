@@ -0,0 +1,253 @@
+#include "./compiler.h"
+#include "./analyze.h"
+#include "./error.h"
+#include "./forms.h"
+#include "./builtins.h"
+
+namespace {
+const SymbolId QUOTE = SymbolValue::idOf("quote");
+const SymbolId IF = SymbolValue::idOf("if");
+const SymbolId DEFINE = SymbolValue::idOf("define");
+const SymbolId LAMBDA = SymbolValue::idOf("lambda");
+const SymbolId BEGIN = SymbolValue::idOf("begin");
+const SymbolId AND = SymbolValue::idOf("and");
+const SymbolId OR = SymbolValue::idOf("or");
+const SymbolId COND = SymbolValue::idOf("cond");
+const SymbolId LET = SymbolValue::idOf("let");
+const SymbolId SET = SymbolValue::idOf("set!");
+const SymbolId ELSE = SymbolValue::idOf("else");
+}
+
+void Compiler::emit(OpCode op) {
+    chunk.code.push_back(static_cast<std::int32_t>(op));
+}
+void Compiler::emit(OpCode op, std::int32_t operand) {
+    emit(op);
+    chunk.code.push_back(operand);
+}
+std::size_t Compiler::emitJump(OpCode op) {
+    emit(op, -1);
+    return chunk.code.size() - 1;
+}
+void Compiler::patchJump(std::size_t operand) {
+    chunk.code[operand] = static_cast<std::int32_t>(chunk.code.size());
+}
+std::int32_t Compiler::addConstant(ValuePtr value) {
+    chunk.constants.push_back(std::move(value));
+    return static_cast<std::int32_t>(chunk.constants.size() - 1);
+}
+
+std::shared_ptr<const Chunk> Compiler::compileTopLevel(const ValuePtr& expr) {
+    auto chunk = std::make_shared<Chunk>();
+    Compiler compiler(*chunk);
+    compiler.compile(expr, true);
+    compiler.emit(OpCode::Return);
+    return chunk;
+}
+
+void Compiler::compileSequence(const std::vector<ValuePtr>& exprs, bool tail) {
+    if (exprs.empty()) {
+        emit(OpCode::Const, addConstant(NilValue::create()));
+        return;
+    }
+    for (std::size_t i = 0; i + 1 < exprs.size(); ++i) {
+        compile(exprs[i], false);
+        emit(OpCode::Pop);
+    }
+    compile(exprs.back(), tail);
+}
+void Compiler::compileLambda(const ValuePtr& paramList, const std::vector<ValuePtr>& body) {
+    auto params = std::make_shared<FrameLayout>();
+    for (auto& param : paramList->toVector()) {
+        params->push_back(symbolCheck(param));
+    }
+    Prototype prototype;
+    prototype.params = std::move(params);
+    auto bodyChunk = std::make_shared<Chunk>();
+    Compiler bodyCompiler(*bodyChunk);
+    bodyCompiler.compileSequence(body, true);
+    bodyCompiler.emit(OpCode::Return);
+    prototype.chunk = std::move(bodyChunk);
+    chunk.prototypes.push_back(std::move(prototype));
+    emit(OpCode::Closure, static_cast<std::int32_t>(chunk.prototypes.size() - 1));
+}
+void Compiler::compileIf(const std::vector<ValuePtr>& args, bool tail) {
+    if (args.size() != 2 && args.size() != 3) {
+        throw LispError("2 or 3 arguments expected but " + std::to_string(args.size()) + " were given in \"if\"");
+    }
+    compile(args[0], false);
+    auto elseJump = emitJump(OpCode::JumpIfFalse);
+    compile(args[1], tail);
+    auto endJump = emitJump(OpCode::Jump);
+    patchJump(elseJump);
+    if (args.size() == 3) {
+        compile(args[2], tail);
+    } else {
+        emit(OpCode::Const, addConstant(NilValue::create()));
+    }
+    patchJump(endJump);
+}
+void Compiler::compileDefine(const std::vector<ValuePtr>& args) {
+    if (args.size() < 2) {
+        throw LispError("Incorrect number of arguments.");
+    }
+    if (auto name = args[0]->asSymbolId()) {
+        numCheck(args, 2);
+        compile(args[1], false);
+        emit(OpCode::Define, *name);
+    } else if (args[0]->getType() == Type::Pair) {
+        auto pair = std::static_pointer_cast<PairValue>(args[0]);
+        auto name = symbolCheck(pair->getCar());
+        compileLambda(pair->getCdr(), std::vector<ValuePtr>(args.begin() + 1, args.end()));
+        emit(OpCode::Define, name);
+    } else {
+        throw LispError("TypeError.");
+    }
+}
+void Compiler::compileAnd(const std::vector<ValuePtr>& args, bool tail) {
+    if (args.empty()) {
+        emit(OpCode::Const, addConstant(BooleanValue::create(true)));
+        return;
+    }
+    std::vector<std::size_t> exits;
+    for (std::size_t i = 0; i + 1 < args.size(); ++i) {
+        compile(args[i], false);
+        exits.push_back(emitJump(OpCode::JumpIfFalseKeep));
+    }
+    compile(args.back(), tail);
+    for (auto exit : exits) patchJump(exit);
+}
+void Compiler::compileOr(const std::vector<ValuePtr>& args, bool tail) {
+    if (args.empty()) {
+        emit(OpCode::Const, addConstant(BooleanValue::create(false)));
+        return;
+    }
+    std::vector<std::size_t> exits;
+    for (std::size_t i = 0; i + 1 < args.size(); ++i) {
+        compile(args[i], false);
+        exits.push_back(emitJump(OpCode::JumpIfTrueKeep));
+    }
+    compile(args.back(), tail);
+    for (auto exit : exits) patchJump(exit);
+}
+void Compiler::compileCond(const std::vector<ValuePtr>& args, bool tail) {
+    if (args.size() == 0) throw LispError("arg expected in \"cond\"");
+    std::vector<std::size_t> exits;
+    bool hasElse = false;
+    for (auto it = args.begin(); it != args.end(); ++it) {
+        if ((*it)->getType() != Type::Pair || !(*it)->isList()) {
+            throw LispError("pairValue expected in \"cond\"");
+        }
+        auto pair = std::static_pointer_cast<PairValue>(*it);
+        auto body = pair->getCdr()->toVector();
+        if (pair->getCar()->asSymbolId() == ELSE) {
+            if (it != args.end() - 1) {
+                throw LispError("\"else\" can only be at the end of \"cond\"");
+            }
+            if (body.empty()) {
+                throw LispError("expression expected after \"else\"");
+            }
+            compileSequence(body, tail);
+            hasElse = true;
+            break;
+        }
+        compile(pair->getCar(), false);
+        if (body.empty()) {
+            exits.push_back(emitJump(OpCode::JumpIfTrueKeep));
+            continue;
+        }
+        auto next = emitJump(OpCode::JumpIfFalse);
+        compileSequence(body, tail);
+        exits.push_back(emitJump(OpCode::Jump));
+        patchJump(next);
+    }
+    if (!hasElse) {
+        emit(OpCode::Fail, addConstant(std::make_shared<StringValue>("all conditions are false")));
+    }
+    for (auto exit : exits) patchJump(exit);
+}
+void Compiler::compileLet(const std::vector<ValuePtr>& args, bool tail) {
+    if (args.size() < 1 || !args[0]->isList()) {
+        throw LispError("first argument should be a list");
+    }
+    auto params = std::make_shared<FrameLayout>();
+    for (auto& binding : args[0]->toVector()) {
+        auto v = binding->toVector(); //{name, val}
+        if (v.size() != 2) {
+            throw LispError("a name should be bound to one val");
+        }
+        params->push_back(symbolCheck(v[0]));
+        compile(v[1], false);
+    }
+    chunk.letParams.push_back(std::move(params));
+    emit(OpCode::EnterLet, static_cast<std::int32_t>(chunk.letParams.size() - 1));
+    compileSequence(std::vector<ValuePtr>(args.begin() + 1, args.end()), tail);
+    //尾调用会直接替换整个调用帧，此后的 LeaveLet 不会执行，也不需要执行
+    emit(OpCode::LeaveLet);
+}
+
+void Compiler::compile(const ValuePtr& expr, bool tail) {
+    if (expr->isSeflEvaluating()) {
+        emit(OpCode::Const, addConstant(expr));
+    } else if (expr->isNil()) {
+        throw LispError("Evaluating nil is prohibited.");
+    } else if (auto name = expr->asSymbolId()) {
+        emit(OpCode::Load, *name);
+    } else if (expr->isList()) {
+        auto pair = std::static_pointer_cast<PairValue>(expr);
+        auto car = pair->getCar();
+        auto args = pair->getCdr()->toVector();
+        if (auto name = car->asSymbolId(); name && SPECIAL_FORMS.contains(*name)) {
+            if (*name == QUOTE) {
+                numCheck(args, 1);
+                emit(OpCode::Const, addConstant(args[0]));
+            } else if (*name == IF) {
+                compileIf(args, tail);
+            } else if (*name == DEFINE) {
+                compileDefine(args);
+            } else if (*name == SET) {
+                numCheck(args, 2);
+                auto target = symbolCheck(args[0]);
+                compile(args[1], false);
+                emit(OpCode::Set, target);
+            } else if (*name == LAMBDA) {
+                if (args.empty()) throw LispError("Incorrect number of arguments.");
+                compileLambda(args[0], std::vector<ValuePtr>(args.begin() + 1, args.end()));
+            } else if (*name == BEGIN) {
+                compileSequence(args, tail);
+            } else if (*name == AND) {
+                compileAnd(args, tail);
+            } else if (*name == OR) {
+                compileOr(args, tail);
+            } else if (*name == COND) {
+                compileCond(args, tail);
+            } else if (*name == LET && (args.empty() || !args[0]->asSymbolId())) {
+                compileLet(args, tail);//named let 与 do 一样交给 Analyzer，在结点中原地循环
+            } else {
+                //结点会在某个子环境中执行，变量只能按名字查找
+                chunk.forms.push_back(Analyzer(true).analyze(expr));
+                emit(OpCode::Form, static_cast<std::int32_t>(chunk.forms.size() - 1));
+            }
+            return;
+        } else if (!name && car->getType() != Type::Pair) {
+            throw LispError("first argument should be symbol");
+        }
+        if (auto expansion = expandMacro(expr)) {
+            compile(expansion, tail);
+            return;
+        }
+        compile(car, false);
+        for (auto& arg : args) {
+            compile(arg, false);
+        }
+        if (auto name = car->asSymbolId(); name && args.size() == 2) {
+            if (auto primitive = findPrimitive(*name)) {
+                emit(OpCode::Primitive, static_cast<std::int32_t>(primitive->op));
+                chunk.code.push_back(addConstant(BUILTIN_FUNCS.at(*name)));
+            }
+        }
+        emit(tail ? OpCode::TailCall : OpCode::Call, static_cast<std::int32_t>(args.size()));
+    } else {
+        throw LispError("Unimplemented");
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+#include <memory>
+#include <vector>
+#include "./bytecode.h"
+
+//把 s-表达式编译为字节码。
+//常用的特殊形式直接编译为跳转和调用指令；其余特殊形式交给 Analyzer，
+//以 Form 指令在虚拟机中执行，因此新增的特殊形式无需修改编译器即可在 --vm 模式下使用。
+class Compiler {
+    Chunk& chunk;
+    void emit(OpCode op);
+    void emit(OpCode op, std::int32_t operand);
+    std::size_t emitJump(OpCode op);//返回待回填的操作数位置
+    void patchJump(std::size_t operand);
+    std::int32_t addConstant(ValuePtr value);
+
+    void compileSequence(const std::vector<ValuePtr>& exprs, bool tail);
+    void compileLambda(const ValuePtr& paramList, const std::vector<ValuePtr>& body);
+    void compileIf(const std::vector<ValuePtr>& args, bool tail);
+    void compileDefine(const std::vector<ValuePtr>& args);
+    void compileAnd(const std::vector<ValuePtr>& args, bool tail);
+    void compileOr(const std::vector<ValuePtr>& args, bool tail);
+    void compileCond(const std::vector<ValuePtr>& args, bool tail);
+    void compileLet(const std::vector<ValuePtr>& args, bool tail);
+    void compile(const ValuePtr& expr, bool tail);
+    Compiler(Chunk& chunk) : chunk{chunk} {}
+public:
+    //编译一个顶层表达式，结果以 Return 结束
+    static std::shared_ptr<const Chunk> compileTopLevel(const ValuePtr& expr);
+};
+
+#endif
@@ -2,7 +2,9 @@
 #include "./error.h"
 #include "./builtins.h"
 #include "./value.h"
-#include "./forms.h"
+#include "./analyze.h"
+#include "./gc.h"
+#include "./pool.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -12,89 +14,131 @@
 
 using namespace std::literals;
 
-EvalEnv::EvalEnv() {
-    //初始化时添加内置过程符号表
-    symbolMap.insert(BUILTIN_FUNCS.begin(), BUILTIN_FUNCS.end());
-
+EvalEnv::EvalEnv(PrivateTag) {
+    GarbageCollector::track(this);
 }
-//把expr转化为vector后的各项求值后插入result
-std::vector<ValuePtr> EvalEnv::evalList(ValuePtr expr) {
-    std::vector<ValuePtr> result;
-    std::ranges::transform(expr->toVector(),
-                           std::back_inserter(result),
-                           [this](ValuePtr v) { return this->eval(v); });
-    return result;
+EvalEnv::~EvalEnv() {
+    GarbageCollector::untrack(this);
+}
+std::shared_ptr<EvalEnv> EvalEnv::createGlobal() {
+    //环境和控制块一起从内存池分配，函数调用产生的短命帧释放后马上被复用
+    auto globalEnv = std::allocate_shared<EvalEnv>(PoolAllocator<EvalEnv>(), PrivateTag{});
+    //初始化时添加内置过程符号表
+    globalEnv->symbolMap.insert(BUILTIN_FUNCS.begin(), BUILTIN_FUNCS.end());
+    return globalEnv;
 }
 //调用内置过程和lambda
-ValuePtr EvalEnv::apply(ValuePtr proc, std::vector<ValuePtr> args) {
-    if (typeid(*proc) == typeid(BuiltinProcValue)) {
-        auto builtin = std::dynamic_pointer_cast<BuiltinProcValue>(proc);
-        auto func = builtin->getFunc();
-        return func(args, *this);
-    } else if (typeid(*proc) == typeid(LambdaValue)) {
-        auto lambda = std::dynamic_pointer_cast<LambdaValue>(proc);
-        return lambda->apply(args);
+ValuePtr EvalEnv::apply(const ValuePtr& proc, std::span<const ValuePtr> args) {
+    if (proc->getType() == Type::BuiltinProc) {
+        return static_cast<BuiltinProcValue&>(*proc).call(args, *this);
+    } else if (proc->getType() == Type::Lambda) {
+        return static_cast<LambdaValue&>(*proc).apply(args);
     } else {
         throw LispError("Unimplemented function \"" + proc->toString() + '\"');
     }
 }
-ValuePtr EvalEnv::lookupBinding(const std::string& name) {
+namespace {
+//按名字查找帧中的绑定。槽位已换成存储单元时返回单元中的绑定，单元为空同样视为未绑定
+ValuePtr* findIn(FrameBindings& frame, SymbolId name) {
+    auto value = frame.find(name);
+    if (value && (*value)->getType() == Type::Box) {
+        value = &static_cast<BoxValue&>(**value).get();
+        if (!*value) return nullptr;
+    }
+    return value;
+}
+}
+ValuePtr EvalEnv::lookupBinding(SymbolId name) {
     auto currentEnv = this;
-    
-    while(currentEnv->symbolMap.find(name) == currentEnv->symbolMap.end()) {
-        currentEnv = currentEnv->parent ? currentEnv->parent.get() : nullptr;
-        if (!currentEnv) break;//parent为nullptr的为最大的环境
+    for (; currentEnv->parent; currentEnv = currentEnv->parent.get()) {
+        if (auto value = findIn(currentEnv->frame, name)) {
+            return *value;
+        }
     }
-    if (currentEnv) {
-        return currentEnv->symbolMap.at(name);
-    } else {
-        throw LispError("Variable \"" + name + "\" not defined.");
+    //parent为nullptr的为最大的环境
+    return currentEnv->globalCell(name);
+}
+ValuePtr& EvalEnv::globalCell(SymbolId name) {
+    auto root = this;
+    while (root->parent) root = root->parent.get();
+    auto it = root->symbolMap.find(name);
+    if (it != root->symbolMap.end()) {
+        return it->second;
     }
+    throw LispError("Variable \"" + SymbolValue::nameOf(name) + "\" not defined.");
 }
-void EvalEnv::defineBinding(const std::string& name, ValuePtr value) {
-    this->symbolMap[name] = value;
+ValuePtr* EvalEnv::findShadow(SymbolId name) {
+    for (auto currentEnv = this; currentEnv->parent; currentEnv = currentEnv->parent.get()) {
+        if (auto value = findIn(currentEnv->frame, name)) {
+            return value;
+        }
+    }
+    return nullptr;
 }
-
-//求值
-ValuePtr EvalEnv::eval(ValuePtr expr) {
-    //std::cout<<expr->toString()<<'\n';
-    if (expr->isSeflEvaluating()) {
-        return expr;
-    } else if (expr->isNil()) {
-        throw LispError("Evaluating nil is prohibited.");
-    } else if (auto name = expr->asSymbol()) {
-        return lookupBinding(name.value());//在自身环境和上级环境中查找
-    } else if(expr->isList()) {
-        std::vector<ValuePtr> v = std::move(expr->toVector());
-        auto pair = std::dynamic_pointer_cast<PairValue>(expr);
-        if (auto name = pair->getCar()->asSymbol()) {
-            //特殊形式
-            if (SPECIAL_FORMS.find(*name) != SPECIAL_FORMS.end()) {
-                return SPECIAL_FORMS.at(*name)(pair->getCdr()->toVector(), *this);
-            } else { //内置过程
-                ValuePtr proc = this->eval(v[0]);
-                std::vector<ValuePtr> args = evalList(pair->getCdr()); //除了符号外，即右半部分
-                return this->apply(proc, args); // 最后用 EvalEnv::apply 实现调用
-            } 
-        } else if (typeid(*(pair->getCar())) == typeid(PairValue)) {
-            auto proc = this->eval(std::dynamic_pointer_cast<PairValue>(pair->getCar()));
-            std::vector<ValuePtr> args = evalList(pair->getCdr());
-            return this->apply(proc, args);
-        } else {
-            throw LispError("first argument should be symbol");
+void EvalEnv::setBinding(SymbolId name, ValuePtr value) {
+    if (auto shadow = findShadow(name)) {
+        *shadow = std::move(value);
+    } else {
+        globalCell(name) = std::move(value);
+    }
+}
+void EvalEnv::defineBinding(SymbolId name, ValuePtr value) {
+    if (parent) {
+        if (frame.define(name, std::move(value))) {
+            ++shadowEpoch;
         }
     } else {
-        throw LispError("Unimplemented");
+        symbolMap[name] = std::move(value);
     }
-} 
+}
+
+//求值：先把 s-表达式分析为结点树，再在本环境中执行。
+//只有在全局环境中分析时，未解析的名字才能确定是全局变量；在子环境中（eval 内置过程）按名字查找
+ValuePtr EvalEnv::eval(ValuePtr expr) {
+    return Analyzer(parent != nullptr).analyze(expr)->eval(*this);
+}
 
-std::shared_ptr<EvalEnv> EvalEnv::createChild(const std::vector<std::string>& params, const std::vector<ValuePtr>& args) {
+std::shared_ptr<EvalEnv> EvalEnv::createChild(const FrameLayoutPtr& layout, std::span<const ValuePtr> args) {
     //设置上级环境
-    auto childEnv = createGlobal();
+    auto childEnv = std::allocate_shared<EvalEnv>(PoolAllocator<EvalEnv>(), PrivateTag{});
     childEnv->parent = shared_from_this();
-    //params与args一一绑定
-    for (int i = 0; i < params.size(); ++i) {
-        childEnv->defineBinding(params[i], args[i]); 
+    //形参与args一一绑定
+    childEnv->frame.setLayout(layout);
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        childEnv->frame.slot(i) = args[i];
     }
+    GarbageCollector::onAllocate();
     return childEnv;
+}
+namespace {
+//帧栈中空闲的帧。有意不析构：程序退出时线程局部的内存池可能已先于它销毁
+std::vector<std::shared_ptr<EvalEnv>>& freeFrames() {
+    static auto frames = new std::vector<std::shared_ptr<EvalEnv>>();
+    return *frames;
+}
+constexpr std::size_t MAX_FREE_FRAMES = 256;//深递归返回后不保留过多空闲帧
+}
+std::shared_ptr<EvalEnv> EvalEnv::acquireChild(const FrameLayoutPtr& layout, std::span<const ValuePtr> args) {
+    auto& frames = freeFrames();
+    if (frames.empty()) {
+        return createChild(layout, args);
+    }
+    auto childEnv = std::move(frames.back());
+    frames.pop_back();
+    childEnv->parent = shared_from_this();
+    childEnv->frame.setLayout(layout);
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        childEnv->frame.slot(i) = args[i];
+    }
+    return childEnv;
+}
+void EvalEnv::releaseChild(std::shared_ptr<EvalEnv>& child) {
+    auto& frames = freeFrames();
+    if (child.use_count() != 1 || frames.size() >= MAX_FREE_FRAMES) {
+        child.reset();
+        return;
+    }
+    child->parent.reset();
+    child->frame.clear();
+    frames.push_back(std::move(child));
 }
\ No newline at end of file
@@ -1,25 +1,198 @@
 #ifndef EVAL_ENV_H
 #define EVAL_ENV_H
 #include "./value.h"
+#include <array>
+#include <span>
 #include <unordered_map>
 #include <string>
+#include <vector>
 class Value;
 using ValuePtr = std::shared_ptr<Value>;
+using SymbolId = int;
+using FrameLayout = std::vector<SymbolId>;
+using FrameLayoutPtr = std::shared_ptr<const FrameLayout>;
+
+//过程调用帧的绑定表。
+//形参和函数体内部 define 的名字在分析时已经确定，按布局分配到连续的槽位，
+//分析后的结点直接按槽位编号读写；少数槽位放在内联数组中，不需要额外的堆分配。
+//布局之外的名字（例如在 eval 中 define 的）只能按名字查找，放在 dynamic 中。
+class FrameBindings {
+public:
+    struct Binding {
+        SymbolId name;
+        ValuePtr value;
+    };
+private:
+    static constexpr std::size_t INLINE_CAPACITY = 4;
+    FrameLayoutPtr layout;
+    std::array<ValuePtr, INLINE_CAPACITY> inlineSlots{};
+    std::vector<ValuePtr> overflowSlots;
+    std::vector<Binding> dynamic;
+public:
+    void setLayout(FrameLayoutPtr newLayout) {
+        layout = std::move(newLayout);
+        if (layout->size() > INLINE_CAPACITY) {
+            overflowSlots.resize(layout->size() - INLINE_CAPACITY);
+        }
+    }
+    ValuePtr& slot(std::size_t index) {
+        return index < INLINE_CAPACITY ? inlineSlots[index] : overflowSlots[index - INLINE_CAPACITY];
+    }
+    //尚未执行到 define 的槽位为空，视为未绑定
+    ValuePtr* find(SymbolId name) {
+        if (layout) {
+            for (std::size_t i = 0; i < layout->size(); ++i) {
+                if ((*layout)[i] == name) {
+                    auto& value = slot(i);
+                    return value ? &value : nullptr;
+                }
+            }
+        }
+        for (auto& binding : dynamic) {
+            if (binding.name == name) return &binding.value;
+        }
+        return nullptr;
+    }
+    //返回是否新增了布局之外的名字
+    bool define(SymbolId name, ValuePtr value) {
+        if (layout) {
+            for (std::size_t i = 0; i < layout->size(); ++i) {
+                if ((*layout)[i] == name) {
+                    slot(i) = std::move(value);
+                    return false;
+                }
+            }
+        }
+        for (auto& binding : dynamic) {
+            if (binding.name == name) {
+                binding.value = std::move(value);
+                return false;
+            }
+        }
+        dynamic.push_back({name, std::move(value)});
+        return true;
+    }
+    //放回帧栈前清空全部绑定
+    void clear() {
+        layout.reset();
+        inlineSlots.fill(nullptr);
+        overflowSlots.clear();
+        dynamic.clear();
+    }
+    template <typename F>
+    void forEach(F&& f) {
+        for (auto& value : inlineSlots) {
+            if (value) f(value);
+        }
+        for (auto& value : overflowSlots) {
+            if (value) f(value);
+        }
+        for (auto& binding : dynamic) f(binding.value);
+    }
+};
+
+//实参窗口：实参个数不超过内联容量时放在调用者的 C++ 栈上，过程调用不需要堆分配。
+//以 span 的形式交给 EvalEnv::apply，被调用者不复制也不持有它
+class ArgBuffer {
+    static constexpr std::size_t INLINE_CAPACITY = 4;
+    std::array<ValuePtr, INLINE_CAPACITY> inlineArgs{};
+    std::vector<ValuePtr> overflow;
+    ValuePtr* data = inlineArgs.data();
+    std::size_t count = 0;
+public:
+    ArgBuffer() = default;
+    ArgBuffer(const ArgBuffer&) = delete;
+    ArgBuffer& operator=(const ArgBuffer&) = delete;
+    //准备 n 个空位，之前的实参被释放
+    void reset(std::size_t n) {
+        for (std::size_t i = 0; i < count; ++i) data[i] = nullptr;
+        if (n <= INLINE_CAPACITY) {
+            data = inlineArgs.data();
+        } else {
+            overflow.resize(n);
+            data = overflow.data();
+        }
+        count = n;
+    }
+    ValuePtr& operator[](std::size_t index) {
+        return data[index];
+    }
+    std::span<const ValuePtr> span() const {
+        return {data, count};
+    }
+};
 
 class EvalEnv : public std::enable_shared_from_this<EvalEnv>{
-    std::vector<ValuePtr> evalList(ValuePtr expr);
-    std::unordered_map<std::string, ValuePtr> symbolMap{};
+    //全局环境（parent 为空）用 symbolMap 保存内置过程和顶层定义；
+    //过程调用和 let 产生的子环境只用 frame 保存自己的少量绑定，内置过程只在全局环境存一份
+    std::unordered_map<SymbolId, ValuePtr> symbolMap{};//以驻留符号的编号为键，查找只需哈希一个整数
+    FrameBindings frame;
     std::shared_ptr<EvalEnv> parent = nullptr;
-    EvalEnv();
+    EvalEnv* prevEnv = nullptr;//GarbageCollector 维护的存活环境链表
+    EvalEnv* nextEnv = nullptr;
+    struct PrivateTag {};//只有 EvalEnv 自己能构造，但允许 allocate_shared 调用构造函数
+    friend class GarbageCollector;
+    friend class VM;
 public:
-    ValuePtr apply(ValuePtr proc, std::vector<ValuePtr> args);
-    std::shared_ptr<EvalEnv> createChild(const std::vector<std::string>& params, const std::vector<ValuePtr>& args);
-    static std::shared_ptr<EvalEnv> createGlobal() {
-        return std::shared_ptr<EvalEnv>(new EvalEnv());
-    }//确保 EvalEnv 的实例总是被 std::shared_ptr 管理
+    explicit EvalEnv(PrivateTag);
+    ~EvalEnv();
+    ValuePtr apply(const ValuePtr& proc, std::span<const ValuePtr> args);
+    //按 layout 创建子帧，args 依次放入前 args.size() 个槽位
+    std::shared_ptr<EvalEnv> createChild(const FrameLayoutPtr& layout, std::span<const ValuePtr> args);
+    //同 createChild，但优先复用帧栈中归还的帧。用于分析时确定不会创建捕获自身帧的闭包的函数体
+    std::shared_ptr<EvalEnv> acquireChild(const FrameLayoutPtr& layout, std::span<const ValuePtr> args);
+    //归还 acquireChild 得到的帧。帧仍被别处持有（例如 eval 在其中创建了闭包）时只放弃自己的引用
+    static void releaseChild(std::shared_ptr<EvalEnv>& child);
+    static std::shared_ptr<EvalEnv> createGlobal();//确保 EvalEnv 的实例总是被 std::shared_ptr 管理
     ValuePtr eval(ValuePtr expr);
-    ValuePtr lookupBinding(const std::string& name);//通过本层级的搜索和向上追溯来找到正确的变量定义
-    void defineBinding(const std::string& name, ValuePtr value);
+    ValuePtr lookupBinding(SymbolId name);//通过本层级的搜索和向上追溯来找到正确的变量定义
+    void defineBinding(SymbolId name, ValuePtr value);
+    //set!：改写最近的已有绑定，找不到时报错
+    void setBinding(SymbolId name, ValuePtr value);
+    //全局变量的存储单元。全局环境中的绑定一经创建地址就不再改变，重新 define 只改写内容，
+    //因此引用结点可以缓存单元的地址，之后直接读取
+    ValuePtr& globalCell(SymbolId name);
+    //在全局环境之前的帧中查找运行时 define 的同名绑定（分析时无法预知）
+    ValuePtr* findShadow(SymbolId name);
+    //子帧每新增一个布局之外的名字就加一；缓存的全局单元记录取得时的值，不一致时重新查找
+    static inline std::size_t shadowEpoch = 0;
+    //词法地址访问：向上 depth 层的帧中的第 slot 个槽位
+    EvalEnv& ancestor(std::size_t depth) {
+        auto env = this;
+        while (depth--) env = env->parent.get();
+        return *env;
+    }
+    ValuePtr& slot(std::size_t index) {
+        return frame.slot(index);
+    }
+    EvalEnv& root() {
+        auto env = this;
+        while (env->parent) env = env->parent.get();
+        return *env;
+    }
+    EvalEnv* getParent() const {
+        return parent.get();
+    }
+};
+
+//一次过程调用或 let 的帧。reuse 为真时从帧栈取得，离开作用域时按后进先出的顺序归还
+class ChildFrame {
+    std::shared_ptr<EvalEnv> env;
+    bool reuse;
+public:
+    ChildFrame(EvalEnv& parent, const FrameLayoutPtr& layout, std::span<const ValuePtr> args, bool reuse)
+        : env{reuse ? parent.acquireChild(layout, args) : parent.createChild(layout, args)}, reuse{reuse} {}
+    ~ChildFrame() {
+        if (reuse) EvalEnv::releaseChild(env);
+    }
+    ChildFrame(const ChildFrame&) = delete;
+    ChildFrame& operator=(const ChildFrame&) = delete;
+    EvalEnv& operator*() const {
+        return *env;
+    }
+    EvalEnv* operator->() const {
+        return env.get();
+    }
 };
 
 #endif
\ No newline at end of file
@@ -1,9 +1,24 @@
 #include "./forms.h"
+#include "./jit.h"
 #include <algorithm>
+#include <cstdint>
 #include <iterator>
-#include <ranges> 
+#include <ranges>
+#include <functional>
 #include <iostream>
 
+const SymbolId UNQUOTE = SymbolValue::idOf("unquote");
+const SymbolId UNQUOTE_SPLICING = SymbolValue::idOf("unquote-splicing");
+const SymbolId QUASIQUOTE = SymbolValue::idOf("quasiquote");
+const SymbolId ELSE = SymbolValue::idOf("else");
+
+//形参、let 绑定名、define 的名字都必须是符号
+SymbolId symbolCheck(const ValuePtr& value) {
+    if (auto id = value->asSymbolId()) {
+        return *id;
+    }
+    throw LispError("symbol expected but \"" + value->toString() + "\" was given");
+}
 void numCheck(const std::vector<ValuePtr>& params, int expectedNum) {
     if (params.size() != expectedNum) {
         throw LispError("Incorrect number of arguments.");
@@ -19,168 +34,895 @@ void paramsCheck(const std::vector<ValuePtr>& params, int expectedNum, Type expe
 }
 
 
-ValuePtr quoteForm(const std::vector<ValuePtr>& args, EvalEnv& env) {
+NodePtr quoteForm(const std::vector<ValuePtr>& args, Analyzer&) {
     numCheck(args, 1);
-    return args[0];
+    return std::make_shared<ConstantNode>(args[0]);
 }
-ValuePtr quasiquoteForm(const std::vector<ValuePtr>& args, EvalEnv& env) {
-    numCheck(args, 1);
-    if (typeid(*args[0]) != typeid(PairValue)) return args[0];
-    auto pair = std::dynamic_pointer_cast<PairValue>(args[0]);
+
+//quasiquote 模板中含有 unquote 的对子：分别构造 car 和 cdr 后新建对子
+class QuasiquotePairNode : public Node {
+    NodePtr car;
+    NodePtr cdr;
+public:
+    QuasiquotePairNode(NodePtr car, NodePtr cdr) : car{std::move(car)}, cdr{std::move(cdr)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        auto carValue = car->eval(env);
+        return PairValue::create(carValue, cdr->eval(env));
+    }
+};
+//模板中的 (,@list . rest)：复制 list 的各项并接在 rest 之前。
+//rest 为空表时与 append 一样直接共享 list，不复制
+class SpliceNode : public Node {
+    NodePtr list;
+    NodePtr rest;
+public:
+    SpliceNode(NodePtr list, NodePtr rest) : list{std::move(list)}, rest{std::move(rest)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        auto items = list->eval(env);
+        auto tail = rest->eval(env);
+        if (!items->isList()) {
+            throw LispError("list expected but \"" + items->toString() + "\" was given in \"unquote-splicing\"");
+        }
+        if (tail->isNil()) return items;
+        ValuePtr head = tail;
+        PairValue* last = nullptr;
+        for (auto current = items; current->getType() == Type::Pair; current = static_cast<PairValue&>(*current).getCdr()) {
+            auto cell = PairValue::create(static_cast<PairValue&>(*current).getCar(), tail);
+            if (last) {
+                last->setCdr(cell);
+            } else {
+                head = cell;
+            }
+            last = static_cast<PairValue*>(cell.get());
+        }
+        return head;
+    }
+};
+//分析第 depth 层 quasiquote 中的模板。
+//不含本层 unquote 的子结构求值结果就是它自己，此时返回空指针，由上层直接共享模板中原来的对象，
+//只有通往 unquote 的路径上的对子才在每次求值时新建
+NodePtr analyzeTemplate(const ValuePtr& tmpl, std::size_t depth, Analyzer& analyzer) {
+    if (tmpl->getType() != Type::Pair) return nullptr;
+    auto pair = std::static_pointer_cast<PairValue>(tmpl);
     ValuePtr car = pair->getCar();
     ValuePtr cdr = pair->getCdr();
-    if (typeid(*car) == typeid(SymbolValue) && car->asSymbol() == "unquote") {
-        if (auto cdrPair = std::dynamic_pointer_cast<PairValue>(cdr)) {
-        return env.eval(cdrPair->getCar());
-        } else return env.eval(cdr);
-    } 
-    car = quasiquoteForm({car}, env);
-    cdr = quasiquoteForm({cdr}, env);
-    return std::make_shared<PairValue>(car, cdr);    
-}
-ValuePtr ifForm(const std::vector<ValuePtr>& args, EvalEnv& env) {
-    auto condition = env.eval(args[0]);
-    if (args.size() == 3) {
-        //如果condition是#f，求值第二个表达式，否则求值第一个
-        if (condition->isFalse()) {
-            return env.eval(args[2]);
-        } else {
-            return env.eval(args[1]);
+    auto head = car->asSymbolId();
+    if (depth == 1) {
+        if (head == UNQUOTE) {
+            if (cdr->getType() == Type::Pair) {
+                return analyzer.analyze(std::static_pointer_cast<PairValue>(cdr)->getCar());
+            } else return analyzer.analyze(cdr);
         }
-    } else if (args.size() == 2) { //实现可以接受忽略 ⟨⟨ 假分支 ⟩⟩ 的条件形式。此时，若 ⟨⟨ 条件 ⟩⟩ 求值为 虚值，则引发未定义行为。建议设置此时的求值结果为空表
-        if (condition->isFalse()) {
-            return std::make_shared<NilValue>();
-        } else {
-            return env.eval(args[1]);
+        if (head == UNQUOTE_SPLICING) {
+            throw LispError("\"unquote-splicing\" can only appear in a list");
         }
-    } else {
+        if (car->getType() == Type::Pair && std::static_pointer_cast<PairValue>(car)->getCar()->asSymbolId() == UNQUOTE_SPLICING) {
+            auto operand = std::static_pointer_cast<PairValue>(car)->getCdr();
+            if (operand->getType() != Type::Pair) throw LispError("Incorrect number of arguments.");
+            auto rest = analyzeTemplate(cdr, depth, analyzer);
+            return std::make_shared<SpliceNode>(analyzer.analyze(std::static_pointer_cast<PairValue>(operand)->getCar()),
+                                                rest ? rest : std::make_shared<ConstantNode>(cdr));
+        }
+    }
+    //嵌套的 quasiquote 中，unquote 要回到外层才求值
+    std::size_t inner = head == QUASIQUOTE ? depth + 1 : head == UNQUOTE || head == UNQUOTE_SPLICING ? depth - 1 : depth;
+    auto carNode = analyzeTemplate(car, depth, analyzer);
+    auto cdrNode = analyzeTemplate(cdr, inner, analyzer);
+    if (!carNode && !cdrNode) return nullptr;
+    return std::make_shared<QuasiquotePairNode>(carNode ? carNode : std::make_shared<ConstantNode>(car),
+                                                cdrNode ? cdrNode : std::make_shared<ConstantNode>(cdr));
+}
+NodePtr quasiquoteForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    numCheck(args, 1);
+    if (auto node = analyzeTemplate(args[0], 1, analyzer)) return node;
+    return std::make_shared<ConstantNode>(args[0]);
+}
+
+class IfNode : public TailNode {
+    NodePtr condition;
+    NodePtr consequent;
+    NodePtr alternative;//省略假分支时为空
+public:
+    IfNode(NodePtr condition, NodePtr consequent, NodePtr alternative)
+        : condition{std::move(condition)}, consequent{std::move(consequent)}, alternative{std::move(alternative)} {}
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        //如果condition是#f，求值第二个表达式，否则求值第一个
+        if (!condition->eval(env)->isFalse()) {
+            return consequent->evalTail(env, tail);
+        } else if (alternative) {
+            return alternative->evalTail(env, tail);
+        } else { //实现可以接受忽略 ⟨⟨ 假分支 ⟩⟩ 的条件形式。此时，若 ⟨⟨ 条件 ⟩⟩ 求值为 虚值，则引发未定义行为。建议设置此时的求值结果为空表
+            return NilValue::create();
+        }
+    }
+};
+NodePtr ifForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    if (args.size() != 2 && args.size() != 3) {
         throw LispError("2 or 3 arguments expected but " + std::to_string(args.size()) + " were given in \"if\"");
     }
+    auto condition = analyzer.analyze(args[0]);
+    auto consequent = analyzer.analyze(args[1]);
+    auto alternative = args.size() == 3 ? analyzer.analyze(args[2]) : nullptr;
+    auto node = std::make_shared<IfNode>(condition, consequent, alternative);
+    //测试为常量时只保留会执行的分支
+    if (auto test = condition->folded(); test && Analyzer::constantFolding) {
+        NodePtr branch = !test->value->isFalse() ? consequent
+                         : alternative        ? alternative
+                                              : std::make_shared<ConstantNode>(NilValue::create());
+        return Analyzer::guarded(std::move(branch), std::move(node), std::move(test->guards));
+    }
+    return node;
 }
-ValuePtr andForm(const std::vector<ValuePtr>& args, EvalEnv& env) {
-    if (args.size() == 0) {
-        return std::make_shared<BooleanValue>(true);
+
+class AndNode : public TailNode {
+    std::vector<NodePtr> operands;
+public:
+    AndNode(std::vector<NodePtr> operands) : operands{std::move(operands)} {}
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        if (operands.empty()) {
+            return BooleanValue::create(true);
+        }
+        for (std::size_t i = 0; i + 1 < operands.size(); ++i) {
+            auto res = operands[i]->eval(env);
+            if (res->isFalse()) {
+                return res;
+            }
+        }
+        return operands.back()->evalTail(env, tail);//返回最后一个值
     }
-    for (auto i : args) {
-        auto condition = env.eval(i);
-        if (condition->isFalse()) {
-            return std::make_shared<BooleanValue>(false);
+};
+NodePtr andForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    return std::make_shared<AndNode>(analyzer.analyzeList(args));
+}
+
+class OrNode : public TailNode {
+    std::vector<NodePtr> operands;
+public:
+    OrNode(std::vector<NodePtr> operands) : operands{std::move(operands)} {}
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        if (operands.empty()) {
+            return BooleanValue::create(false);
         }
+        for (std::size_t i = 0; i + 1 < operands.size(); ++i) {
+            auto condition = operands[i]->eval(env);
+            if (!condition->isFalse()) {
+                return condition;//返回第一个不为#f的值
+            }
+        }
+        return operands.back()->evalTail(env, tail);
     }
-    return env.eval(args[args.size() - 1]);//返回最后一个值
+};
+NodePtr orForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    return std::make_shared<OrNode>(analyzer.analyzeList(args));
 }
-ValuePtr orForm(const std::vector<ValuePtr>& args, EvalEnv& env) {
-    if (args.size() == 0) {
-        return std::make_shared<BooleanValue>(false);
+
+//lambda 的函数体只在这里分析一次，之后每次创建闭包都共享同一组结点和帧布局
+class LambdaNode : public Node {
+    FrameLayoutPtr layout;
+    std::size_t arity;
+    std::shared_ptr<const std::vector<NodePtr>> body;
+    std::shared_ptr<JitState> jit;
+    std::shared_ptr<const InlineBody> inlined;
+    bool reuseFrames;
+    std::optional<std::vector<Capture>> captures;//扁平闭包捕获的外层变量；为空时闭包保留整条环境链
+    FrameLayoutPtr captureLayout;
+    //扁平闭包的环境：捕获帧只含用到的外层变量，上级是全局环境；没有捕获时直接使用全局环境
+    std::shared_ptr<EvalEnv> closureEnv(EvalEnv& env) const {
+        if (!captures) {
+            return env.shared_from_this();
+        }
+        auto& root = env.root();
+        if (captures->empty()) {
+            return root.shared_from_this();
+        }
+        ArgBuffer values;
+        values.reset(captures->size());
+        for (std::size_t i = 0; i < captures->size(); ++i) {
+            auto& capture = (*captures)[i];
+            auto& source = env.ancestor(capture.depth).slot(capture.slot);
+            if (capture.boxed && (!source || source->getType() != Type::Box)) {
+                source = BoxValue::create(std::move(source));//第一次被捕获时才换成存储单元
+            }
+            values[i] = source;
+        }
+        return root.createChild(captureLayout, values.span());
     }
-    for (auto i : args) {
-        auto condition = env.eval(i);
-        if(!condition->isFalse()) {
-            return condition;//返回第一个不为#f的值
+public:
+    LambdaNode(FrameLayoutPtr layout, std::size_t arity, std::vector<NodePtr> body, std::shared_ptr<JitState> jit,
+               std::shared_ptr<const InlineBody> inlined, bool reuseFrames, std::optional<std::vector<Capture>> captures)
+        : layout{std::move(layout)}, arity{arity}, body{std::make_shared<const std::vector<NodePtr>>(std::move(body))},
+          jit{std::move(jit)}, inlined{std::move(inlined)}, reuseFrames{reuseFrames}, captures{std::move(captures)} {
+        if (this->captures) {
+            auto names = std::make_shared<FrameLayout>();
+            for (auto& capture : *this->captures) names->push_back(capture.name);
+            captureLayout = std::move(names);
         }
     }
-    return std::make_shared<BooleanValue>(false);
-}
-ValuePtr labmdaForm(const std::vector<ValuePtr>& args, EvalEnv& env) {
-    std::vector<std::string> params;
+    ValuePtr eval(EvalEnv& env) override {
+        return std::make_shared<LambdaValue>(layout, arity, body, closureEnv(env), jit, inlined, reuseFrames);
+    }
+};
+NodePtr labmdaForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    if (args.size() < 1) {
+        throw LispError("Incorrect number of arguments.");
+    }
+    auto layout = std::make_shared<FrameLayout>();
     std::ranges::transform(args[0]->toVector(),
-                           std::back_inserter(params),
-                           [](ValuePtr v) { return v->toString(); });//args[0]中各项转化为字符串后插入params中
+                           std::back_inserter(*layout),
+                           symbolCheck);//args[0]中各项转化为符号编号后插入形参槽位
+    std::size_t arity = layout->size();
     std::vector<ValuePtr> body(args.begin() + 1, args.end());//body
-    return std::make_shared<LambdaValue>(params, body, env.shared_from_this());
+    auto jit = std::make_shared<JitState>(*layout, body);
+    FrameLayout params = *layout;
+    std::optional<std::vector<Capture>> captures;
+    if (analyzer.flatClosures() && !Analyzer::usesEval(body)) captures.emplace();
+    auto nodes = analyzer.analyzeBody(body, layout, captures ? &*captures : nullptr);
+    auto inlined = analyzer.topLevel() ? Analyzer::makeInline(params, body) : nullptr;
+    bool reuseFrames = !Analyzer::capturesFrame(body, analyzer.flatClosures());
+    return std::make_shared<LambdaNode>(std::move(layout), arity, std::move(nodes), std::move(jit), std::move(inlined),
+                                        reuseFrames, std::move(captures));
 }
-ValuePtr defineForm(const std::vector<ValuePtr>& args, EvalEnv& env) {
-    std::string name;
-    ValuePtr value;
+
+//全局或无法静态解析的 define：按名字绑定
+class DefineNode : public Node {
+    SymbolId name;
+    NodePtr value;
+public:
+    DefineNode(SymbolId name, NodePtr value) : name{name}, value{std::move(value)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        env.defineBinding(name, value->eval(env));
+        return NilValue::create();
+    }
+};
+//函数体内部的 define：写入当前帧分析时分配的槽位
+class LocalDefineNode : public Node {
+    std::size_t slot;
+    NodePtr value;
+public:
+    LocalDefineNode(std::size_t slot, NodePtr value) : slot{slot}, value{std::move(value)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        env.slot(slot) = value->eval(env);
+        return NilValue::create();
+    }
+};
+//被闭包捕获的内部 define：槽位已换成存储单元时写入单元，闭包也能看到新值
+class BoxedDefineNode : public Node {
+    std::size_t slot;
+    NodePtr value;
+public:
+    BoxedDefineNode(std::size_t slot, NodePtr value) : slot{slot}, value{std::move(value)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        auto result = value->eval(env);
+        auto& target = env.slot(slot);
+        if (target && target->getType() == Type::Box) {
+            static_cast<BoxValue&>(*target).get() = std::move(result);
+        } else {
+            target = std::move(result);
+        }
+        return NilValue::create();
+    }
+};
+NodePtr makeDefine(SymbolId name, const std::function<NodePtr()>& analyzeValue, Analyzer& analyzer) {
+    //先分配槽位再分析值，值中对自身的引用（递归的内部过程）才能解析到这个槽位
+    if (auto slot = analyzer.defineSlot(name)) {
+        if (analyzer.isBoxed(name)) {
+            return std::make_shared<BoxedDefineNode>(*slot, analyzeValue());
+        }
+        return std::make_shared<LocalDefineNode>(*slot, analyzeValue());
+    }
+    return std::make_shared<DefineNode>(name, analyzeValue());
+}
+NodePtr defineForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
     if (args.size() < 2) {
         throw LispError("Incorrect number of arguments.");
     }
-    if (args[0]->asSymbol()) {
+    if (auto name = args[0]->asSymbolId()) {
         numCheck(args, 2);
-        name = args[0]->asSymbol().value();
-        value = env.eval(args[1]);
-        env.defineBinding(name, value);
-        return std::make_shared<NilValue>();
-    } else if (auto pair = std::dynamic_pointer_cast<PairValue>(args[0])) {
+        return makeDefine(*name, [&] { return analyzer.analyze(args[1]); }, analyzer);
+    } else if (args[0]->getType() == Type::Pair) {
+        auto pair = std::static_pointer_cast<PairValue>(args[0]);
         std::vector<ValuePtr> lambdaArgs = {pair->getCdr()};//第一个元素为形参列表
         lambdaArgs.insert(lambdaArgs.end(), args.begin() + 1, args.end());//剩下的元素为表达式中剩下的元素
-        name = pair->getCar()->toString();
-        value = labmdaForm(lambdaArgs, env);
-        env.defineBinding(name, value);
-        return std::make_shared<NilValue>();
+        return makeDefine(symbolCheck(pair->getCar()), [&] { return labmdaForm(lambdaArgs, analyzer); }, analyzer);
     } else {
         throw LispError("TypeError.");
     }
 };
-ValuePtr condForm(const std::vector<ValuePtr>& args, EvalEnv& env) {
+
+//(set! name value)：改写已有的绑定。只有被闭包捕获的局部变量经过存储单元，其余直接改写槽位或全局单元
+NodePtr setForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    numCheck(args, 2);
+    auto name = symbolCheck(args[0]);
+    return analyzer.analyzeAssignment(name, analyzer.analyze(args[1]));
+}
+
+//把求得的闭包换成带结果缓存的副本
+class MemoizeNode : public Node {
+    NodePtr lambda;
+public:
+    MemoizeNode(NodePtr lambda) : lambda{std::move(lambda)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        return static_cast<LambdaValue&>(*lambda->eval(env)).memoized(0);
+    }
+};
+//(define-memoized (name param ...) body ...)
+//与 define 过程相同，但绑定的是 memoize 后的过程，函数体中对 name 的递归调用也经过缓存
+NodePtr defineMemoizedForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    if (args.size() < 2 || args[0]->getType() != Type::Pair) {
+        throw LispError("Incorrect number of arguments.");
+    }
+    auto pair = std::static_pointer_cast<PairValue>(args[0]);
+    std::vector<ValuePtr> lambdaArgs = {pair->getCdr()};
+    lambdaArgs.insert(lambdaArgs.end(), args.begin() + 1, args.end());
+    return makeDefine(symbolCheck(pair->getCar()), [&] {
+        return std::make_shared<MemoizeNode>(labmdaForm(lambdaArgs, analyzer));
+    }, analyzer);
+}
+
+class BeginNode : public TailNode {
+    std::vector<NodePtr> body;
+public:
+    BeginNode(std::vector<NodePtr> body) : body{std::move(body)} {}
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        return evalSequenceTail(body, env, tail);
+    }
+};
+
+class CondNode : public TailNode {
+public:
+    struct Clause {
+        NodePtr test;//else 子句为空
+        std::vector<NodePtr> body;
+    };
+private:
+    std::vector<Clause> clauses;
+public:
+    CondNode(std::vector<Clause> clauses) : clauses{std::move(clauses)} {}
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        for (auto& clause : clauses) {
+            if (!clause.test) {
+                return evalSequenceTail(clause.body, env, tail);
+            }
+            auto cond = clause.test->eval(env);
+            if (!cond->isFalse()) {
+                if (clause.body.empty()) return cond;
+                return evalSequenceTail(clause.body, env, tail);
+            }
+        }
+        throw LispError("all conditions are false");
+    }
+};
+NodePtr condForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
     if (args.size() == 0) throw LispError("arg expected in \"cond\"");
+    std::vector<CondNode::Clause> clauses;
     for (auto it = args.begin(); it != args.end(); ++it) {
-        if ((*it)->isList()) {
-            auto pair = std::dynamic_pointer_cast<PairValue>(*it);
-            if (auto sym = std::dynamic_pointer_cast<SymbolValue>(pair->getCar())) {
-                if(sym->asSymbol() == "else") {
-                    if (it == args.end() - 1) {
-                    auto cdr = std::dynamic_pointer_cast<PairValue>(pair->getCdr());
-                    return env.eval(cdr->getCar());
-                    } else {
-                        throw LispError("\"else\" can only be at the end of \"cond\"");
-                    }
-                }
+        if ((*it)->getType() != Type::Pair || !(*it)->isList()) {
+            throw LispError("pairValue expected in \"cond\"");
+        }
+        auto pair = std::static_pointer_cast<PairValue>(*it);
+        auto body = analyzer.analyzeList(pair->getCdr()->toVector());
+        if (pair->getCar()->asSymbolId() == ELSE) {
+            if (it != args.end() - 1) {
+                throw LispError("\"else\" can only be at the end of \"cond\"");
             }
-            auto cond = env.eval(pair->getCar());
-            if (!cond->isFalse()) {
-                if (pair->getCdr()->isNil()) return cond;
-                auto vec = pair->toVector();
-                ValuePtr res = nullptr;
-                for (auto i : vec) {
-                    res = env.eval(i);
+            if (body.empty()) {
+                throw LispError("expression expected after \"else\"");
+            }
+            clauses.push_back({nullptr, std::move(body)});
+        } else {
+            clauses.push_back({analyzer.analyze(pair->getCar()), std::move(body)});
+        }
+    }
+    auto node = std::make_shared<CondNode>(clauses);
+    if (!Analyzer::constantFolding) return node;
+    //去掉测试恒为假的子句；测试恒为真的子句成为 else，其后的子句不可达
+    std::vector<CondNode::Clause> reachable;
+    std::vector<FoldGuard> guards;
+    bool changed = false;
+    for (auto& clause : clauses) {
+        auto test = clause.test ? clause.test->folded() : std::nullopt;
+        if (!test) {
+            reachable.push_back(clause);
+            if (!clause.test) break;
+            continue;
+        }
+        changed = true;
+        Analyzer::mergeGuards(guards, test->guards);
+        if (!test->value->isFalse()) {
+            auto body = clause.body.empty() ? std::vector<NodePtr>{clause.test} : clause.body;
+            reachable.push_back({nullptr, std::move(body)});
+            break;
+        }
+    }
+    if (!changed) return node;
+    NodePtr fast;
+    if (!reachable.empty() && !reachable.front().test) {
+        fast = std::make_shared<BeginNode>(std::move(reachable.front().body));
+    } else {
+        fast = std::make_shared<CondNode>(std::move(reachable));
+    }
+    return Analyzer::guarded(std::move(fast), std::move(node), std::move(guards));
+}
+
+//(case key ((datum ...) body ...) ... (else body ...))
+//datum 与 key 按 eq? 的语义比较。符号和数在分析时按子句建成哈希表，分派时只查找一次，与子句个数无关
+class CaseNode : public TailNode {
+public:
+    static constexpr std::size_t NO_MATCH = SIZE_MAX;
+private:
+    NodePtr key;
+    std::unordered_map<SymbolId, std::size_t> symbols;
+    std::unordered_map<double, std::size_t> numbers;
+    std::vector<std::pair<ValuePtr, std::size_t>> others;//布尔值和空表，最多三项
+    std::vector<std::vector<NodePtr>> bodies;
+    std::size_t fallback = NO_MATCH;//else 子句的下标
+public:
+    CaseNode(NodePtr key) : key{std::move(key)} {}
+    //同一个 datum 出现在多个子句中时，前面的子句优先
+    void addClause(const std::vector<ValuePtr>& datums, std::vector<NodePtr> body) {
+        std::size_t index = bodies.size();
+        bodies.push_back(std::move(body));
+        for (auto& datum : datums) {
+            if (auto name = datum->asSymbolId()) {
+                symbols.emplace(*name, index);
+            } else if (datum->getType() == Type::Number) {
+                double x = static_cast<NumericValue&>(*datum).getVal();
+                numbers.emplace(x == 0 ? 0 : x, index);//0 与 -0 是同一个键
+            } else if (datum->getType() == Type::Boolean || datum->isNil()) {
+                if (std::ranges::none_of(others, [&](auto& other) { return other.first->isEqual(*datum); })) {
+                    others.push_back({datum, index});
                 }
-                return res;
             }
+            //字符串和列表按身份比较，不会与运行时的值相同，忽略
+        }
+    }
+    void setElse(std::vector<NodePtr> body) {
+        fallback = bodies.size();
+        bodies.push_back(std::move(body));
+    }
+    std::size_t select(Value& value) const {
+        if (auto name = value.asSymbolId()) {
+            auto it = symbols.find(*name);
+            return it != symbols.end() ? it->second : fallback;
+        }
+        if (value.getType() == Type::Number) {
+            double x = static_cast<NumericValue&>(value).getVal();
+            auto it = numbers.find(x == 0 ? 0 : x);
+            return it != numbers.end() ? it->second : fallback;
+        }
+        for (auto& [datum, index] : others) {
+            if (datum->getType() == value.getType() && datum->isEqual(value)) return index;
+        }
+        return fallback;
+    }
+    const std::vector<NodePtr>& body(std::size_t index) const {
+        return bodies[index];
+    }
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        auto index = select(*key->eval(env));
+        if (index == NO_MATCH) {
+            throw LispError("no clause matches the key in \"case\"");
+        }
+        return evalSequenceTail(bodies[index], env, tail);
+    }
+};
+NodePtr caseForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    if (args.size() < 2) throw LispError("key and clauses expected in \"case\"");
+    auto key = analyzer.analyze(args[0]);
+    auto node = std::make_shared<CaseNode>(key);
+    for (auto it = args.begin() + 1; it != args.end(); ++it) {
+        if ((*it)->getType() != Type::Pair || !(*it)->isList()) {
+            throw LispError("pairValue expected in \"case\"");
+        }
+        auto pair = std::static_pointer_cast<PairValue>(*it);
+        auto body = analyzer.analyzeList(pair->getCdr()->toVector());
+        if (body.empty()) {
+            throw LispError("expression expected in \"case\" clause");
+        }
+        if (pair->getCar()->asSymbolId() == ELSE) {
+            if (it != args.end() - 1) {
+                throw LispError("\"else\" can only be at the end of \"case\"");
+            }
+            node->setElse(std::move(body));
+        } else if (pair->getCar()->isList()) {
+            node->addClause(pair->getCar()->toVector(), std::move(body));
         } else {
-            throw LispError("pairValue expected in \"cond\"");
+            throw LispError("datum list expected in \"case\"");
         }
     }
-    throw LispError("all conditions are false");
+    //键为常量时只保留会执行的子句
+    auto folded = key->folded();
+    if (!folded || !Analyzer::constantFolding) return node;
+    auto index = node->select(*folded->value);
+    if (index == CaseNode::NO_MATCH) return node;
+    return Analyzer::guarded(std::make_shared<BeginNode>(node->body(index)), node, std::move(folded->guards));
 }
-ValuePtr beginForm(const std::vector<ValuePtr>& args, EvalEnv& env) {
-    ValuePtr res = nullptr;
-    for (auto arg : args) {
-        res = env.eval(arg);
+
+NodePtr beginForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    auto body = analyzer.analyzeList(args);
+    auto node = std::make_shared<BeginNode>(body);
+    if (!Analyzer::constantFolding || body.size() < 2) return node;
+    //最后一项之前的常量求值后被丢弃，也没有副作用，可以删去
+    std::vector<NodePtr> live;
+    std::vector<FoldGuard> guards;
+    for (std::size_t i = 0; i + 1 < body.size(); ++i) {
+        if (auto value = body[i]->folded()) {
+            Analyzer::mergeGuards(guards, value->guards);
+        } else {
+            live.push_back(body[i]);
+        }
     }
-    return res;
+    if (live.size() + 1 == body.size()) return node;
+    live.push_back(body.back());
+    NodePtr fast = live.size() == 1 ? live.front() : std::make_shared<BeginNode>(std::move(live));
+    return Analyzer::guarded(std::move(fast), std::move(node), std::move(guards));
 }
-ValuePtr letForm(const std::vector<ValuePtr>& args, EvalEnv& env) {
-    std::vector<std::string> params;
-    std::vector<ValuePtr> arguments;
-    std::vector<ValuePtr> body(args.begin() + 1, args.end());
-    if (!args[0]->isList()) {
+
+//let 直接创建子环境求值函数体，不再构造临时的 LambdaValue
+class LetNode : public TailNode {
+    FrameLayoutPtr layout;
+    std::vector<NodePtr> inits;
+    std::vector<NodePtr> body;
+    bool reuseFrames;//函数体不会捕获 let 的帧
+public:
+    LetNode(FrameLayoutPtr layout, std::vector<NodePtr> inits, std::vector<NodePtr> body, bool reuseFrames)
+        : layout{std::move(layout)}, inits{std::move(inits)}, body{std::move(body)}, reuseFrames{reuseFrames} {}
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        ArgBuffer arguments;
+        arguments.reset(inits.size());
+        for (std::size_t i = 0; i < inits.size(); ++i) {
+            arguments[i] = inits[i]->eval(env);
+        }
+        ChildFrame child{env, layout, arguments.span(), reuseFrames};
+        return evalSequenceTail(body, *child, tail);
+    }
+};
+NodePtr namedLetForm(const std::vector<ValuePtr>& args, Analyzer& analyzer);
+NodePtr letForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    if (!args.empty() && args[0]->asSymbolId()) {
+        return namedLetForm(args, analyzer);
+    }
+    auto layout = std::make_shared<FrameLayout>();
+    std::vector<NodePtr> inits;
+    if (args.size() < 1 || !args[0]->isList()) {
         throw LispError("first argument should be a list");
     }
-    auto vec = std::dynamic_pointer_cast<PairValue>(args[0])->toVector(); //{(name, val), (name, val), ...}
+    auto vec = args[0]->toVector(); //{(name, val), (name, val), ...}
     for (auto p : vec) {
-        auto v = std::dynamic_pointer_cast<PairValue>(p)->toVector(); //{name, val}
+        auto v = p->toVector(); //{name, val}
         if (v.size() != 2) {
             throw LispError("a name should be bound to one val");
         }
-        params.push_back(v[0]->toString());
-        arguments.push_back(env.eval(v[1]));
+        layout->push_back(symbolCheck(v[0]));
+        inits.push_back(analyzer.analyze(v[1]));//初值在外层作用域中分析
     }
-    auto lambda = std::make_shared<LambdaValue>(params, body, env.shared_from_this());
-    return env.apply(lambda, arguments);
+    std::vector<ValuePtr> body(args.begin() + 1, args.end());
+    auto nodes = analyzer.analyzeBody(body, layout);
+    return std::make_shared<LetNode>(std::move(layout), std::move(inits), std::move(nodes), !Analyzer::capturesFrame(body, analyzer.flatClosures()));
 }
 
+//循环变量的帧。函数体不会捕获帧时，每一轮都在同一个帧中原地重新绑定；
+//否则（例如 dynamic 模式下函数体中有 lambda）每一轮换一个新帧，已创建的闭包仍看到自己那一轮的绑定
+class LoopFrame {
+    EvalEnv& parent;
+    const FrameLayoutPtr& layout;
+    bool inPlace;
+    std::optional<ChildFrame> frame;
+public:
+    LoopFrame(EvalEnv& parent, const FrameLayoutPtr& layout, std::span<const ValuePtr> args, bool inPlace)
+        : parent{parent}, layout{layout}, inPlace{inPlace} {
+        frame.emplace(parent, layout, args, inPlace);
+    }
+    EvalEnv& operator*() const {
+        return **frame;
+    }
+    //进入下一轮：前 args.size() 个槽位换成 args，函数体中 define 的槽位恢复为未绑定
+    void rebind(ArgBuffer& args) {
+        if (!inPlace) {
+            frame.emplace(parent, layout, args.span(), false);
+            return;
+        }
+        auto& env = **frame;
+        auto count = args.span().size();
+        for (std::size_t i = 0; i < count; ++i) {
+            env.slot(i) = std::move(args[i]);
+        }
+        for (std::size_t i = count; i < layout->size(); ++i) {
+            env.slot(i) = nullptr;
+        }
+    }
+};
+
+//原地循环的 named let。循环体中对循环名字的调用（LoopCallNode）以 marker 为过程返回尾调用，
+//这里认出它后重新绑定循环变量再执行一轮；其他尾调用照常交给外层
+class LoopNode : public TailNode {
+    FrameLayoutPtr layout;
+    std::vector<NodePtr> inits;
+    std::vector<NodePtr> body;
+    ValuePtr marker;
+    bool inPlace;
+public:
+    LoopNode(FrameLayoutPtr layout, std::vector<NodePtr> inits, std::vector<NodePtr> body, ValuePtr marker, bool inPlace)
+        : layout{std::move(layout)}, inits{std::move(inits)}, body{std::move(body)}, marker{std::move(marker)}, inPlace{inPlace} {}
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        ArgBuffer arguments;
+        arguments.reset(inits.size());
+        for (std::size_t i = 0; i < inits.size(); ++i) {
+            arguments[i] = inits[i]->eval(env);
+        }
+        LoopFrame frame{env, layout, arguments.span(), inPlace};
+        while (true) {
+            if (auto result = evalSequenceTail(body, *frame, tail)) {
+                return result;
+            }
+            if (tail.proc != marker) {
+                return nullptr;
+            }
+            frame.rebind(tail.args);
+        }
+    }
+};
+//标记只在循环结点内部传递；分析保证对循环名字的调用都在尾位置，这里只是防御
+ValuePtr loopEscaped(std::span<const ValuePtr>, EvalEnv&) {
+    throw LispError("named let called outside tail position");
+}
+//(let name ((var init) ...) body ...)
+NodePtr namedLetForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    auto name = symbolCheck(args[0]);
+    if (args.size() < 2 || !args[1]->isList()) {
+        throw LispError("second argument should be a list");
+    }
+    auto layout = std::make_shared<FrameLayout>();
+    std::vector<ValuePtr> params;
+    std::vector<ValuePtr> initExprs;
+    for (auto& binding : args[1]->toVector()) {
+        auto v = binding->toVector(); //{name, val}
+        if (v.size() != 2) {
+            throw LispError("a name should be bound to one val");
+        }
+        layout->push_back(symbolCheck(v[0]));
+        params.push_back(v[0]);
+        initExprs.push_back(v[1]);
+    }
+    std::vector<ValuePtr> body(args.begin() + 2, args.end());
+    if (!Analyzer::loopsInPlace(name, params.size(), body)) {
+        //name 被当作值使用或不在尾位置调用时，按定义展开为 (((lambda () (define (name var ...) body ...) name)) init ...)
+        auto list = [](const std::vector<ValuePtr>& items, ValuePtr tail) {
+            for (auto i = items.size(); i > 0; --i) tail = PairValue::create(items[i - 1], tail);
+            return tail;
+        };
+        auto nil = NilValue::create();
+        auto nameValue = args[0];
+        auto define = PairValue::create(SymbolValue::intern("define"),
+                                        PairValue::create(PairValue::create(nameValue, list(params, nil)), list(body, nil)));
+        auto procedure = list({list({SymbolValue::intern("lambda"), nil, define, nameValue}, nil)}, nil);
+        return analyzer.analyze(PairValue::create(procedure, list(initExprs, nil)));
+    }
+    std::vector<NodePtr> inits;
+    for (auto& init : initExprs) {
+        inits.push_back(analyzer.analyze(init));//初值在外层作用域中分析
+    }
+    auto marker = std::make_shared<BuiltinProcValue>(&loopEscaped);
+    auto nodes = analyzer.analyzeLoopBody(body, layout, name, marker);
+    bool inPlace = !Analyzer::capturesFrame(body, analyzer.flatClosures());
+    return std::make_shared<LoopNode>(std::move(layout), std::move(inits), std::move(nodes), std::move(marker), inPlace);
+}
+
+//每一轮先求测试，为真时求值结果表达式并结束；否则执行函数体，再用全部步进表达式的值同时重新绑定循环变量
+class DoNode : public TailNode {
+    FrameLayoutPtr layout;
+    std::vector<NodePtr> inits;
+    std::vector<NodePtr> steps;//没有步进表达式的变量为对它自身的引用
+    NodePtr test;
+    std::vector<NodePtr> results;
+    std::vector<NodePtr> body;
+    bool inPlace;
+public:
+    DoNode(FrameLayoutPtr layout, std::vector<NodePtr> inits, std::vector<NodePtr> steps, NodePtr test,
+           std::vector<NodePtr> results, std::vector<NodePtr> body, bool inPlace)
+        : layout{std::move(layout)}, inits{std::move(inits)}, steps{std::move(steps)}, test{std::move(test)},
+          results{std::move(results)}, body{std::move(body)}, inPlace{inPlace} {}
+    ValuePtr evalTail(EvalEnv& env, TailCall& tail) override {
+        ArgBuffer values;
+        values.reset(inits.size());
+        for (std::size_t i = 0; i < inits.size(); ++i) {
+            values[i] = inits[i]->eval(env);
+        }
+        LoopFrame frame{env, layout, values.span(), inPlace};
+        while (test->eval(*frame)->isFalse()) {
+            for (auto& node : body) {
+                node->eval(*frame);
+            }
+            for (std::size_t i = 0; i < steps.size(); ++i) {
+                values[i] = steps[i]->eval(*frame);
+            }
+            frame.rebind(values);
+        }
+        return evalSequenceTail(results, *frame, tail);
+    }
+};
+//(do ((var init [step]) ...) (test expr ...) body ...)
+NodePtr doForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    if (args.size() < 2 || !args[0]->isList()) {
+        throw LispError("first argument should be a list");
+    }
+    if (args[1]->getType() != Type::Pair || !args[1]->isList()) {
+        throw LispError("test clause expected in \"do\"");
+    }
+    auto layout = std::make_shared<FrameLayout>();
+    std::vector<NodePtr> inits;
+    std::vector<ValuePtr> stepExprs;
+    for (auto& spec : args[0]->toVector()) {
+        auto v = spec->toVector(); //{name, init, step}
+        if (v.size() != 2 && v.size() != 3) {
+            throw LispError("a do variable should have an init and an optional step");
+        }
+        layout->push_back(symbolCheck(v[0]));
+        inits.push_back(analyzer.analyze(v[1]));//初值在外层作用域中分析
+        stepExprs.push_back(v.size() == 3 ? v[2] : v[0]);
+    }
+    //测试、结果、函数体和步进表达式都在 do 的帧中分析，一起交给 analyzeBody 后再按个数分开
+    auto clause = args[1]->toVector();
+    std::vector<ValuePtr> exprs = clause;
+    exprs.insert(exprs.end(), args.begin() + 2, args.end());
+    exprs.insert(exprs.end(), stepExprs.begin(), stepExprs.end());
+    auto nodes = analyzer.analyzeBody(exprs, layout);
+    auto bodyBegin = nodes.begin() + clause.size();
+    auto stepsBegin = nodes.end() - stepExprs.size();
+    bool inPlace = !Analyzer::capturesFrame(exprs, analyzer.flatClosures());
+    return std::make_shared<DoNode>(std::move(layout), std::move(inits), std::vector<NodePtr>(stepsBegin, nodes.end()),
+                                    nodes.front(), std::vector<NodePtr>(nodes.begin() + 1, bodyBegin),
+                                    std::vector<NodePtr>(bodyBegin, stepsBegin), inPlace);
+}
+
+//delay 的表达式分析为无参闭包，承诺第一次被 force 时调用它
+class DelayNode : public Node {
+    NodePtr thunk;
+public:
+    DelayNode(NodePtr thunk) : thunk{std::move(thunk)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        return PromiseValue::create(thunk->eval(env));
+    }
+};
+NodePtr delayThunk(const ValuePtr& expr, Analyzer& analyzer) {
+    return labmdaForm({NilValue::create(), expr}, analyzer);
+}
+//(delay expr)
+NodePtr delayForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    numCheck(args, 1);
+    return std::make_shared<DelayNode>(delayThunk(args[0], analyzer));
+}
+class ConsStreamNode : public Node {
+    NodePtr head;
+    NodePtr thunk;
+public:
+    ConsStreamNode(NodePtr head, NodePtr thunk) : head{std::move(head)}, thunk{std::move(thunk)} {}
+    ValuePtr eval(EvalEnv& env) override {
+        auto value = head->eval(env);
+        return PairValue::create(value, PromiseValue::create(thunk->eval(env)));
+    }
+};
+//(cons-stream a b) 即 (cons a (delay b))
+NodePtr consStreamForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    numCheck(args, 2);
+    auto head = analyzer.analyze(args[0]);
+    return std::make_shared<ConsStreamNode>(std::move(head), delayThunk(args[1], analyzer));
+}
+
+namespace {
+struct Macro {
+    ValuePtr transformer;//以未求值的操作数为实参调用，返回展开结果
+    std::size_t fixed;//固定参数个数
+    bool rest;//是否有收集其余操作数的参数
+    std::size_t version;//每次 define-macro 都不同，使旧的缓存失效
+};
+struct Expansion {
+    std::weak_ptr<Value> form;//确认缓存项对应的仍是同一个形式对象
+    std::size_t version;
+    ValuePtr result;
+};
+constexpr std::size_t MAX_CACHED_EXPANSIONS = 4096;
+//宏表和缓存有意不析构：其中的闭包引用的环境来自线程局部内存池，程序退出时内存池可能已先销毁
+auto& macros = *new std::unordered_map<SymbolId, Macro>();
+auto& expansions = *new std::unordered_map<const Value*, Expansion>();
+std::size_t macroVersion = 0;
+}
+bool isMacro(SymbolId name) {
+    return macros.contains(name);
+}
+ValuePtr expandMacro(const ValuePtr& form) {
+    auto pair = std::static_pointer_cast<PairValue>(form);
+    auto name = pair->getCar()->asSymbolId();
+    if (!name) return nullptr;
+    auto it = macros.find(*name);
+    if (it == macros.end()) return nullptr;
+    auto& macro = it->second;
+    if (auto hit = expansions.find(form.get()); hit != expansions.end()) {
+        if (hit->second.version == macro.version && hit->second.form.lock() == form) {
+            return hit->second.result;
+        }
+    }
+    auto operands = pair->getCdr()->toVector();
+    if (operands.size() < macro.fixed || (!macro.rest && operands.size() > macro.fixed)) {
+        throw LispError("Incorrect number of arguments.");
+    }
+    if (macro.rest) {
+        ValuePtr rest = NilValue::create();
+        for (auto i = operands.size(); i > macro.fixed; --i) {
+            rest = PairValue::create(operands[i - 1], rest);
+        }
+        operands.resize(macro.fixed);
+        operands.push_back(std::move(rest));
+    }
+    auto transformer = macro.transformer;//变换过程可能重新定义这个宏
+    auto version = macro.version;
+    auto result = static_cast<LambdaValue&>(*transformer).apply(operands);
+    if (expansions.size() >= MAX_CACHED_EXPANSIONS) {
+        std::erase_if(expansions, [](const auto& entry) { return entry.second.form.expired(); });
+        if (expansions.size() >= MAX_CACHED_EXPANSIONS) expansions.clear();
+    }
+    expansions[form.get()] = {form, version, result};
+    return result;
+}
+
+class DefineMacroNode : public Node {
+    SymbolId name;
+    NodePtr transformer;
+    std::size_t fixed;
+    bool rest;
+public:
+    DefineMacroNode(SymbolId name, NodePtr transformer, std::size_t fixed, bool rest)
+        : name{name}, transformer{std::move(transformer)}, fixed{fixed}, rest{rest} {}
+    ValuePtr eval(EvalEnv& env) override {
+        macros[name] = {transformer->eval(env), fixed, rest, ++macroVersion};
+        return NilValue::create();
+    }
+};
+//(define-macro (name param ... [. rest]) body ...)
+//变换过程是在当前环境中创建的普通闭包，rest 收集多余的操作数组成的列表
+NodePtr defineMacroForm(const std::vector<ValuePtr>& args, Analyzer& analyzer) {
+    if (args.size() < 2 || args[0]->getType() != Type::Pair) {
+        throw LispError("Incorrect number of arguments.");
+    }
+    auto pair = std::static_pointer_cast<PairValue>(args[0]);
+    auto name = symbolCheck(pair->getCar());
+    ValuePtr params = NilValue::create();
+    std::vector<ValuePtr> names;
+    auto current = pair->getCdr();
+    for (; current->getType() == Type::Pair; current = std::static_pointer_cast<PairValue>(current)->getCdr()) {
+        names.push_back(std::static_pointer_cast<PairValue>(current)->getCar());
+    }
+    std::size_t fixed = names.size();
+    bool rest = !current->isNil();
+    if (rest) {
+        symbolCheck(current);
+        names.push_back(current);
+    }
+    for (auto i = names.size(); i > 0; --i) {
+        params = PairValue::create(names[i - 1], params);
+    }
+    std::vector<ValuePtr> lambdaArgs = {params};
+    lambdaArgs.insert(lambdaArgs.end(), args.begin() + 1, args.end());
+    return std::make_shared<DefineMacroNode>(name, labmdaForm(lambdaArgs, analyzer), fixed, rest);
+}
 
-const std::unordered_map<std::string, SpecialFormType*> SPECIAL_FORMS = {
-    {"define", defineForm}, 
-    {"quote", quoteForm}, 
-    {"if", ifForm}, 
-    {"and", andForm}, 
-    {"or", orForm}, 
-    {"lambda", labmdaForm},
-    {"cond", condForm},
-    {"begin", beginForm},
-    {"let", letForm}, 
-    {"quasiquote",quasiquoteForm}, 
+const std::unordered_map<SymbolId, SpecialFormType*> SPECIAL_FORMS = {
+    {SymbolValue::idOf("define"), defineForm},
+    {SymbolValue::idOf("quote"), quoteForm},
+    {SymbolValue::idOf("if"), ifForm},
+    {SymbolValue::idOf("and"), andForm},
+    {SymbolValue::idOf("or"), orForm},
+    {SymbolValue::idOf("lambda"), labmdaForm},
+    {SymbolValue::idOf("cond"), condForm},
+    {SymbolValue::idOf("case"), caseForm},
+    {SymbolValue::idOf("begin"), beginForm},
+    {SymbolValue::idOf("let"), letForm},
+    {SymbolValue::idOf("quasiquote"), quasiquoteForm},
+    {SymbolValue::idOf("define-macro"), defineMacroForm},
+    {SymbolValue::idOf("define-memoized"), defineMemoizedForm},
+    {SymbolValue::idOf("delay"), delayForm},
+    {SymbolValue::idOf("cons-stream"), consStreamForm},
+    {SymbolValue::idOf("do"), doForm},
+    {SymbolValue::idOf("set!"), setForm},
     //其他特殊形式
 };
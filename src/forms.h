@@ -4,10 +4,22 @@
 #include "./value.h"
 #include "./eval_env.h"
 #include "./error.h"
+#include "./analyze.h"
 
 using ValuePtr = std::shared_ptr<Value>;
-using SpecialFormType = ValuePtr(const std::vector<ValuePtr>&, EvalEnv&);
-extern const std::unordered_map<std::string, SpecialFormType*> SPECIAL_FORMS;
+//特殊形式在分析阶段把参数翻译为可执行结点
+using SpecialFormType = NodePtr(const std::vector<ValuePtr>&, Analyzer&);
+extern const std::unordered_map<SymbolId, SpecialFormType*> SPECIAL_FORMS;
+
+//define-macro 定义的（非卫生）宏。宏在分析或编译时展开，结点树和字节码中只保留展开结果；
+//展开结果还按源形式缓存，同一个形式对象再次分析（例如反复 eval 同一个表达式）时不再调用变换过程
+bool isMacro(SymbolId name);
+//form 的运算符是宏时返回展开结果，否则返回空指针
+ValuePtr expandMacro(const ValuePtr& form);
+
+//特殊形式共用的语法检查，字节码编译器也使用它们
+SymbolId symbolCheck(const ValuePtr& value);
+void numCheck(const std::vector<ValuePtr>& params, int expectedNum);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "./gc.h"
+#include "./eval_env.h"
+#include "./value.h"
+#include "./memo.h"
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+EvalEnv* GarbageCollector::head = nullptr;
+std::size_t GarbageCollector::liveEnvs = 0;
+std::size_t GarbageCollector::liveContainers = 0;
+std::size_t GarbageCollector::sinceLastCollect = 0;
+std::size_t GarbageCollector::threshold = 10000;
+
+void GarbageCollector::track(EvalEnv* env) {
+    env->prevEnv = nullptr;
+    env->nextEnv = head;
+    if (head) head->prevEnv = env;
+    head = env;
+    ++liveEnvs;
+}
+void GarbageCollector::untrack(EvalEnv* env) {
+    if (env->prevEnv) env->prevEnv->nextEnv = env->nextEnv;
+    else head = env->nextEnv;
+    if (env->nextEnv) env->nextEnv->prevEnv = env->prevEnv;
+    --liveEnvs;
+}
+void GarbageCollector::onAllocate() {
+    if (++sinceLastCollect < threshold) return;
+    collect();
+    //一次回收要遍历所有存活的环境和容器值，下次回收前允许的分配数与它们的总数成正比，
+    //这样每次分配摊到的回收代价与存活堆的大小无关
+    threshold = std::max<std::size_t>(10000, 2 * (liveEnvs + liveContainers));
+}
+
+namespace {
+//回收图中的结点只有环境和可能引用环境的容器值（对子、lambda、存储单元和承诺）
+bool isContainer(const ValuePtr& value) {
+    return value && (value->getType() == Type::Pair || value->getType() == Type::Lambda || value->getType() == Type::Box ||
+                     value->getType() == Type::Promise);
+}
+}
+
+std::size_t GarbageCollector::collect() {
+    sinceLastCollect = 0;
+    //第一步：记录每个结点的强引用计数
+    std::unordered_map<const void*, long> refs;
+    std::vector<EvalEnv*> envs;
+    std::vector<Value*> values;
+    std::vector<const ValuePtr*> pending;
+    auto discover = [&](const ValuePtr& value) {
+        if (isContainer(value) && refs.emplace(value.get(), value.use_count()).second) {
+            values.push_back(value.get());
+            pending.push_back(&value);
+        }
+    };
+    for (auto env = head; env; env = env->nextEnv) {
+        long count = env->weak_from_this().use_count();
+        //尚未交给 shared_ptr 管理的环境一律当作根
+        refs[env] = count > 0 ? count : 1L << 40;
+        envs.push_back(env);
+    }
+    for (auto env : envs) {
+        for (auto& [name, value] : env->symbolMap) discover(value);
+        env->frame.forEach(discover);
+    }
+    while (!pending.empty()) {
+        auto& value = *pending.back();
+        pending.pop_back();
+        if (value->getType() == Type::Pair) {
+            auto pair = static_cast<PairValue*>(value.get());
+            discover(pair->left);
+            discover(pair->right);
+        } else if (value->getType() == Type::Box) {
+            discover(static_cast<BoxValue*>(value.get())->value);
+        } else if (value->getType() == Type::Promise) {
+            auto promise = static_cast<PromiseValue*>(value.get());
+            discover(promise->proc);
+            for (auto& arg : promise->args) discover(arg);
+            discover(promise->value);
+        } else if (auto memo = static_cast<LambdaValue*>(value.get())->memo.get()) {
+            memo->forEach(discover);
+        }
+    }
+
+    //第二步：减去图内部的引用，剩余为正的结点被外部（全局环境的持有者、C++ 栈）引用
+    auto forEachEdge = [](auto&& visitEnv, auto&& visitValue, auto* node) {
+        using Node = std::remove_cvref_t<decltype(*node)>;
+        if constexpr (std::is_same_v<Node, EvalEnv>) {
+            if (node->parent) visitEnv(node->parent.get());
+            for (auto& [name, value] : node->symbolMap) {
+                if (isContainer(value)) visitValue(value.get());
+            }
+            node->frame.forEach([&](const ValuePtr& value) {
+                if (isContainer(value)) visitValue(value.get());
+            });
+        } else if (node->getType() == Type::Pair) {
+            auto pair = static_cast<PairValue*>(node);
+            if (isContainer(pair->left)) visitValue(pair->left.get());
+            if (isContainer(pair->right)) visitValue(pair->right.get());
+        } else if (node->getType() == Type::Box) {
+            auto box = static_cast<BoxValue*>(node);
+            if (isContainer(box->value)) visitValue(box->value.get());
+        } else if (node->getType() == Type::Promise) {
+            auto promise = static_cast<PromiseValue*>(node);
+            if (isContainer(promise->proc)) visitValue(promise->proc.get());
+            for (auto& arg : promise->args) {
+                if (isContainer(arg)) visitValue(arg.get());
+            }
+            if (isContainer(promise->value)) visitValue(promise->value.get());
+        } else {
+            auto lambda = static_cast<LambdaValue*>(node);
+            if (lambda->initEnv) visitEnv(lambda->initEnv.get());
+            if (lambda->memo) {
+                lambda->memo->forEach([&](const ValuePtr& value) {
+                    if (isContainer(value)) visitValue(value.get());
+                });
+            }
+        }
+    };
+    auto decrement = [&](const void* target) {
+        --refs[target];
+    };
+    for (auto env : envs) forEachEdge(decrement, decrement, env);
+    for (auto value : values) forEachEdge(decrement, decrement, value);
+
+    //第三步：从根出发标记可达结点
+    std::unordered_set<const void*> marked;
+    std::vector<EvalEnv*> envStack;
+    std::vector<Value*> valueStack;
+    auto markEnv = [&](EvalEnv* env) {
+        if (marked.insert(env).second) envStack.push_back(env);
+    };
+    auto markValue = [&](Value* value) {
+        if (marked.insert(value).second) valueStack.push_back(value);
+    };
+    for (auto env : envs) {
+        if (refs[env] > 0) markEnv(env);
+    }
+    for (auto value : values) {
+        if (refs[value] > 0) markValue(value);
+    }
+    while (!envStack.empty() || !valueStack.empty()) {
+        if (!envStack.empty()) {
+            auto env = envStack.back();
+            envStack.pop_back();
+            forEachEdge(markEnv, markValue, env);
+        } else {
+            auto value = valueStack.back();
+            valueStack.pop_back();
+            forEachEdge(markEnv, markValue, value);
+        }
+    }
+
+    liveContainers = std::ranges::count_if(values, [&](Value* value) { return marked.contains(value); });
+
+    //第四步：清空不可达环境的绑定以打断环，真正的释放交给 shared_ptr
+    std::vector<std::shared_ptr<EvalEnv>> garbage;
+    for (auto env : envs) {
+        if (!marked.contains(env)) garbage.push_back(env->shared_from_this());
+    }
+    std::vector<decltype(EvalEnv::symbolMap)> maps;
+    std::vector<FrameBindings> frames;
+    std::vector<std::shared_ptr<EvalEnv>> parents;
+    for (auto& env : garbage) {
+        maps.push_back(std::move(env->symbolMap));
+        env->symbolMap.clear();
+        frames.push_back(std::move(env->frame));
+        env->frame = FrameBindings();
+        parents.push_back(std::move(env->parent));
+    }
+    std::size_t collected = garbage.size();
+    maps.clear();
+    frames.clear();
+    parents.clear();
+    garbage.clear();
+    return collected;
+}
@@ -0,0 +1,27 @@
+#ifndef GC_H
+#define GC_H
+#include <cstddef>
+class EvalEnv;
+
+//回收 LambdaValue 与 EvalEnv 之间的引用环。
+//shared_ptr 负责无环对象的释放；这里只处理 define 出的过程与其定义环境互相持有的情况。
+//采用试探删除（trial deletion）：对每个环境和容器值，用引用计数减去图内部的引用，
+//剩余为正的对象说明被 C++ 栈等外部持有，作为根；从根出发不可达的环境即为垃圾。
+//因此在求值过程中的任意时刻触发回收都是安全的。
+class GarbageCollector {
+    static EvalEnv* head;//所有存活环境组成的侵入式双向链表
+    static std::size_t liveEnvs;
+    static std::size_t liveContainers;//上次回收后仍可达的容器值个数
+    static std::size_t sinceLastCollect;
+    static std::size_t threshold;
+public:
+    static void track(EvalEnv* env);
+    static void untrack(EvalEnv* env);
+    static void onAllocate();//每创建一个环境调用一次，累计到阈值时触发回收
+    static std::size_t collect();//返回回收的环境数
+    static std::size_t liveCount() {
+        return liveEnvs;
+    }
+};
+
+#endif
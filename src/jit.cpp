@@ -0,0 +1,368 @@
+#include "./jit.h"
+#include "./builtins.h"
+#include "./eval_env.h"
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <unordered_map>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_ENABLED 1
+#include <sys/mman.h>
+#endif
+
+JitState::JitState(std::vector<SymbolId> params, std::vector<ValuePtr> body)
+    : params{std::move(params)}, body{std::move(body)} {}
+
+JitState::~JitState() {
+#ifdef JIT_ENABLED
+    if (code) munmap(code, codeSize);
+#endif
+}
+
+#ifdef JIT_ENABLED
+namespace {
+//机器码与 C++ 之间共享的状态。机器码不会调用回 C++，同一时刻只有一段机器码在运行
+bool deoptFlag = false;
+std::uintptr_t savedRsp = 0;//入口处的 rsp，去优化时据此一次退回 C++
+std::uintptr_t stackLimit = 0;//rsp 低于它就去优化，避免递归过深撑爆机器栈
+constexpr std::uintptr_t NATIVE_STACK_BUDGET = 256 * 1024;
+constexpr std::size_t MAX_PARAMS = 8;//形参放在 xmm0 ~ xmm7 中传递
+
+const SymbolId IF = SymbolValue::idOf("if");
+}
+
+//把函数体翻译为机器码。只用到 rax、rbp、rsp 和 xmm0 ~ xmm7。
+//函数体内部的调用约定：实参在 xmm0 ~ xmm(n-1)，结果在 xmm0；形参保存在 [rbp - 8(i+1)]。
+//表达式的结果总是放在 xmm0，二元运算的左操作数暂存在机器栈上
+class JitCompiler {
+    JitState& state;
+    EvalEnv& root;
+    std::vector<std::uint8_t> buf;
+    std::vector<std::size_t> deoptJumps;//跳往去优化出口的 rel32 位置
+    std::size_t bodyStart = 0;
+    std::size_t loopStart = 0;//形参保存之后，尾部自调用跳回这里
+    std::unordered_map<SymbolId, std::size_t> guardedCells;
+
+    void bytes(std::initializer_list<std::uint8_t> data) {
+        buf.insert(buf.end(), data);
+    }
+    void imm32(std::int32_t value) {
+        std::uint8_t raw[4];
+        std::memcpy(raw, &value, 4);
+        buf.insert(buf.end(), raw, raw + 4);
+    }
+    void imm64(std::uint64_t value) {
+        std::uint8_t raw[8];
+        std::memcpy(raw, &value, 8);
+        buf.insert(buf.end(), raw, raw + 8);
+    }
+    void movRaxImm(const void* address) {
+        bytes({0x48, 0xB8});//mov rax, imm64
+        imm64(reinterpret_cast<std::uint64_t>(address));
+    }
+    //发出带 rel32 的跳转，返回待回填的位置
+    std::size_t jump(std::initializer_list<std::uint8_t> opcode) {
+        bytes(opcode);
+        imm32(0);
+        return buf.size() - 4;
+    }
+    void patch(std::size_t at, std::size_t target) {
+        std::int32_t rel = static_cast<std::int32_t>(target) - static_cast<std::int32_t>(at + 4);
+        std::memcpy(&buf[at], &rel, 4);
+    }
+    void pushXmm0() {
+        bytes({0x48, 0x83, 0xEC, 0x08});//sub rsp, 8
+        bytes({0xF2, 0x0F, 0x11, 0x04, 0x24});//movsd [rsp], xmm0
+    }
+    //栈顶弹出到 xmm0，原来的 xmm0 移到 xmm1
+    void popLhs() {
+        bytes({0xF2, 0x0F, 0x10, 0xC8});//movsd xmm1, xmm0
+        bytes({0xF2, 0x0F, 0x10, 0x04, 0x24});//movsd xmm0, [rsp]
+        bytes({0x48, 0x83, 0xC4, 0x08});//add rsp, 8
+    }
+    void loadParam(int reg, std::size_t index) {
+        bytes({0xF2, 0x0F, 0x10, static_cast<std::uint8_t>(0x85 | reg << 3)});//movsd xmmR, [rbp + disp32]
+        imm32(-8 * static_cast<std::int32_t>(index + 1));
+    }
+    void storeParam(int reg, std::size_t index) {
+        bytes({0xF2, 0x0F, 0x11, static_cast<std::uint8_t>(0x85 | reg << 3)});//movsd [rbp + disp32], xmmR
+        imm32(-8 * static_cast<std::int32_t>(index + 1));
+    }
+    void loadStack(int reg, std::size_t offset) {
+        bytes({0xF2, 0x0F, 0x10, static_cast<std::uint8_t>(0x84 | reg << 3), 0x24});//movsd xmmR, [rsp + disp32]
+        imm32(static_cast<std::int32_t>(offset));
+    }
+
+    //全局名字当前绑定的值，并记录守卫
+    std::optional<ValuePtr> global(SymbolId name, const Value* builtin) {
+        ValuePtr* cell;
+        try {
+            cell = &root.globalCell(name);
+        } catch (...) {
+            return std::nullopt;
+        }
+        if (!guardedCells.contains(name)) {
+            guardedCells[name] = state.guards.size();
+            state.guards.push_back({cell, builtin});
+        }
+        return *cell;
+    }
+    std::optional<std::size_t> paramIndex(SymbolId name) {
+        auto it = std::ranges::find(state.params, name);
+        if (it == state.params.end()) return std::nullopt;
+        return it - state.params.begin();
+    }
+    bool isSelf(SymbolId name) {
+        if (paramIndex(name)) return false;
+        ValuePtr* cell;
+        try {
+            cell = &root.globalCell(name);
+        } catch (...) {
+            return false;
+        }
+        auto& value = *cell;
+        return value->getType() == Type::Lambda && static_cast<LambdaValue&>(*value).jit.get() == &state
+            && global(name, nullptr).has_value();
+    }
+    //(op a b) 形式且 op 是未被重新定义的内置过程
+    std::optional<Primitive> primitiveCall(SymbolId name, std::size_t argc) {
+        if (argc != 2 || paramIndex(name)) return std::nullopt;
+        auto primitive = findPrimitive(name);
+        if (!primitive) return std::nullopt;
+        auto value = global(name, primitive->builtin);
+        if (!value || value->get() != primitive->builtin) return std::nullopt;
+        return primitive->op;
+    }
+
+    bool compileArgs(const std::vector<ValuePtr>& args) {
+        for (auto& arg : args) {
+            if (!compile(arg, false)) return false;
+            pushXmm0();
+        }
+        return true;
+    }
+    //条件为假时跳到返回的位置（待回填）
+    bool compileTest(const ValuePtr& test, std::vector<std::size_t>& falseJumps) {
+        if (test->getType() != Type::Pair || !test->isList()) return false;
+        auto pair = std::static_pointer_cast<PairValue>(test);
+        auto name = pair->getCar()->asSymbolId();
+        auto args = pair->getCdr()->toVector();
+        if (!name) return false;
+        auto op = primitiveCall(*name, args.size());
+        if (!op || *op == Primitive::Add || *op == Primitive::Subtract || *op == Primitive::Multiply) return false;
+        if (!compileArgs(args)) return false;
+        bytes({0xF2, 0x0F, 0x10, 0x0C, 0x24});//movsd xmm1, [rsp]  (右操作数)
+        bytes({0xF2, 0x0F, 0x10, 0x44, 0x24, 0x08});//movsd xmm0, [rsp + 8]  (左操作数)
+        bytes({0x48, 0x83, 0xC4, 0x10});//add rsp, 16
+        //ucomisd 在无序（NaN）时置 ZF、PF、CF，下面的跳转都让 NaN 比较为假
+        switch (*op) {
+            case Primitive::Less:
+                bytes({0x66, 0x0F, 0x2E, 0xC8});//ucomisd xmm1, xmm0
+                falseJumps.push_back(jump({0x0F, 0x86}));//jbe
+                break;
+            case Primitive::LessEq:
+                bytes({0x66, 0x0F, 0x2E, 0xC8});
+                falseJumps.push_back(jump({0x0F, 0x82}));//jb
+                break;
+            case Primitive::Greater:
+                bytes({0x66, 0x0F, 0x2E, 0xC1});//ucomisd xmm0, xmm1
+                falseJumps.push_back(jump({0x0F, 0x86}));
+                break;
+            case Primitive::GreaterEq:
+                bytes({0x66, 0x0F, 0x2E, 0xC1});
+                falseJumps.push_back(jump({0x0F, 0x82}));
+                break;
+            default://Equal
+                bytes({0x66, 0x0F, 0x2E, 0xC1});
+                falseJumps.push_back(jump({0x0F, 0x85}));//jne
+                falseJumps.push_back(jump({0x0F, 0x8A}));//jp
+                break;
+        }
+        return true;
+    }
+    bool compile(const ValuePtr& expr, bool tail) {
+        if (expr->getType() == Type::Number) {
+            double value = static_cast<NumericValue&>(*expr).getVal();
+            std::uint64_t raw;
+            std::memcpy(&raw, &value, 8);
+            bytes({0x48, 0xB8});
+            imm64(raw);
+            bytes({0x66, 0x48, 0x0F, 0x6E, 0xC0});//movq xmm0, rax
+            return true;
+        }
+        if (auto name = expr->asSymbolId()) {
+            auto index = paramIndex(*name);
+            if (!index) return false;
+            loadParam(0, *index);
+            return true;
+        }
+        if (expr->getType() != Type::Pair || !expr->isList()) return false;
+        auto pair = std::static_pointer_cast<PairValue>(expr);
+        auto name = pair->getCar()->asSymbolId();
+        if (!name) return false;
+        auto args = pair->getCdr()->toVector();
+        if (*name == IF && !paramIndex(IF)) {
+            //缺省的假分支结果是空表，不是数，不编译
+            if (args.size() != 3) return false;
+            std::vector<std::size_t> falseJumps;
+            if (!compileTest(args[0], falseJumps)) return false;
+            if (!compile(args[1], tail)) return false;
+            auto endJump = jump({0xE9});
+            for (auto at : falseJumps) patch(at, buf.size());
+            if (!compile(args[2], tail)) return false;
+            patch(endJump, buf.size());
+            return true;
+        }
+        if (isSelf(*name)) {
+            if (args.size() != state.params.size()) return false;
+            if (!compileArgs(args)) return false;
+            std::size_t n = args.size();
+            if (tail) {
+                //尾部自调用：实参写回形参的位置后跳回函数体开头，不占用机器栈
+                for (std::size_t i = 0; i < n; ++i) {
+                    loadStack(0, 8 * (n - 1 - i));
+                    storeParam(0, i);
+                }
+                if (n) {
+                    bytes({0x48, 0x81, 0xC4});//add rsp, imm32
+                    imm32(static_cast<std::int32_t>(8 * n));
+                }
+                patch(jump({0xE9}), loopStart);
+                return true;
+            }
+            for (std::size_t i = 0; i < n; ++i) {
+                loadStack(static_cast<int>(i), 8 * (n - 1 - i));
+            }
+            if (n) {
+                bytes({0x48, 0x81, 0xC4});
+                imm32(static_cast<std::int32_t>(8 * n));
+            }
+            patch(jump({0xE8}), bodyStart);//call body
+            return true;
+        }
+        auto op = primitiveCall(*name, args.size());
+        if (!op) return false;
+        std::uint8_t opcode;
+        switch (*op) {
+            case Primitive::Add: opcode = 0x58; break;
+            case Primitive::Subtract: opcode = 0x5C; break;
+            case Primitive::Multiply: opcode = 0x59; break;
+            default: return false;//比较的结果是布尔值，只允许出现在 if 的测试中
+        }
+        if (!compile(args[0], false)) return false;
+        pushXmm0();
+        if (!compile(args[1], false)) return false;
+        popLhs();
+        bytes({0xF2, 0x0F, opcode, 0xC1});//addsd/subsd/mulsd xmm0, xmm1
+        return true;
+    }
+public:
+    JitCompiler(JitState& state, EvalEnv& root) : state{state}, root{root} {}
+
+    //成功时返回机器码，入口在偏移 0 处
+    std::optional<std::vector<std::uint8_t>> run() {
+        std::size_t n = state.params.size();
+        if (n > MAX_PARAMS || state.body.size() != 1) return std::nullopt;
+
+        //入口：double entry(const double* args)
+        bytes({0x55});//push rbp
+        movRaxImm(&savedRsp);
+        bytes({0x48, 0x89, 0x20});//mov [rax], rsp
+        for (std::size_t i = 0; i < n; ++i) {
+            bytes({0xF2, 0x0F, 0x10, static_cast<std::uint8_t>(0x87 | i << 3)});//movsd xmmI, [rdi + disp32]
+            imm32(static_cast<std::int32_t>(8 * i));
+        }
+        auto callBody = jump({0xE8});
+        bytes({0x5D, 0xC3});//pop rbp; ret
+
+        //去优化出口：标记后把 rsp 恢复到入口处，直接返回 C++
+        std::size_t deopt = buf.size();
+        movRaxImm(&deoptFlag);
+        bytes({0xC6, 0x00, 0x01});//mov byte [rax], 1
+        movRaxImm(&savedRsp);
+        bytes({0x48, 0x8B, 0x20});//mov rsp, [rax]
+        bytes({0x5D, 0xC3});
+
+        //函数体
+        bodyStart = buf.size();
+        patch(callBody, bodyStart);
+        movRaxImm(&stackLimit);
+        bytes({0x48, 0x3B, 0x20});//cmp rsp, [rax]
+        deoptJumps.push_back(jump({0x0F, 0x82}));//jb deopt
+        bytes({0x55, 0x48, 0x89, 0xE5});//push rbp; mov rbp, rsp
+        if (n) {
+            bytes({0x48, 0x81, 0xEC});//sub rsp, imm32
+            imm32(static_cast<std::int32_t>(8 * n));
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            storeParam(static_cast<int>(i), i);
+        }
+        loopStart = buf.size();
+        if (!compile(state.body[0], true)) return std::nullopt;
+        bytes({0x48, 0x89, 0xEC, 0x5D, 0xC3});//mov rsp, rbp; pop rbp; ret
+        for (auto at : deoptJumps) patch(at, deopt);
+        return std::move(buf);
+    }
+};
+
+bool JitState::compile(const LambdaValue& lambda) {
+    //只编译顶层定义的过程，这样形参以外的名字一定是全局变量
+    if (lambda.initEnv->getParent()) return false;
+    guards.clear();
+    auto machineCode = JitCompiler(*this, *lambda.initEnv).run();
+    if (!machineCode) {
+        guards.clear();
+        return false;
+    }
+    //先以可写方式映射并写入，再改为只读可执行
+    codeSize = machineCode->size();
+    void* memory = mmap(nullptr, codeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return false;
+    std::memcpy(memory, machineCode->data(), codeSize);
+    if (mprotect(memory, codeSize, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, codeSize);
+        return false;
+    }
+    code = memory;
+    entry = reinterpret_cast<EntryType*>(memory);
+    return true;
+}
+
+ValuePtr JitState::tryRun(const LambdaValue& lambda, std::span<const ValuePtr> args) {
+    if (status == Status::Cold) {
+        if (++calls < THRESHOLD) return nullptr;
+        status = compile(lambda) ? Status::Compiled : Status::Rejected;
+    }
+    if (status != Status::Compiled || lambda.initEnv->getParent()) return nullptr;
+    //入口守卫：全局绑定没有改变、实参都是数。不满足时这次调用交给解释器
+    for (auto& guard : guards) {
+        auto& value = *guard.cell;
+        if (guard.builtin ? value.get() != guard.builtin
+                          : value->getType() != Type::Lambda || static_cast<LambdaValue&>(*value).jit.get() != this) {
+            return nullptr;
+        }
+    }
+    double unboxed[MAX_PARAMS];
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        if (args[i]->getType() != Type::Number) return nullptr;
+        unboxed[i] = static_cast<NumericValue&>(*args[i]).getVal();
+    }
+    char marker;
+    stackLimit = reinterpret_cast<std::uintptr_t>(&marker) - NATIVE_STACK_BUDGET;
+    deoptFlag = false;
+    double result = entry(unboxed);
+    if (deoptFlag) return nullptr;
+    return NumericValue::create(result);
+}
+
+#else
+
+bool JitState::compile(const LambdaValue& lambda) {
+    return false;
+}
+ValuePtr JitState::tryRun(const LambdaValue& lambda, std::span<const ValuePtr> args) {
+    return nullptr;
+}
+
+#endif
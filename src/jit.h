@@ -0,0 +1,48 @@
+#ifndef JIT_H
+#define JIT_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+#include "./value.h"
+
+//数值过程的即时编译。
+//顶层定义的 lambda 被调用足够多次后，若函数体只由形参、数字常量、二元 + - *、
+//if（测试为二元比较）和对自身的调用组成，就把它编译为 x86-64 机器码，
+//形参和中间结果都以未装箱的 double 保存在寄存器和机器栈上。
+//这样的函数体没有副作用，所以去优化很简单：机器码递归太深时直接丢弃本次的执行，
+//回到解释器从头执行这次调用。
+//只在 Linux x86-64 上启用，其他平台上所有 lambda 都留在解释器中。
+class JitState {
+public:
+    //解释执行这么多次之后才尝试编译
+    static constexpr std::size_t THRESHOLD = 1000;
+private:
+    using EntryType = double(const double* args);
+    enum class Status { Cold, Compiled, Rejected };
+    //机器码假定的全局绑定：运算符仍是原来的内置过程，自调用的名字仍绑定着同一个 lambda 表达式的闭包
+    struct Guard {
+        const ValuePtr* cell;
+        const Value* builtin;//为空表示这是自调用的名字
+    };
+    std::vector<SymbolId> params;
+    std::vector<ValuePtr> body;//函数体的 s-表达式
+    std::size_t calls = 0;
+    Status status = Status::Cold;
+    std::vector<Guard> guards;
+    void* code = nullptr;//mmap 得到的可执行内存
+    std::size_t codeSize = 0;
+    EntryType* entry = nullptr;
+    bool compile(const LambdaValue& lambda);
+    friend class JitCompiler;
+public:
+    JitState(std::vector<SymbolId> params, std::vector<ValuePtr> body);
+    ~JitState();
+    JitState(const JitState&) = delete;
+    JitState& operator=(const JitState&) = delete;
+    //计数并在需要时编译；能以机器码完成这次调用时返回结果，否则返回空指针，由解释器执行
+    ValuePtr tryRun(const LambdaValue& lambda, std::span<const ValuePtr> args);
+};
+
+#endif
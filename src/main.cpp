@@ -6,14 +6,21 @@
 #include "./eval_env.h"
 #include <fstream>
 #include "./error.h"
+#include "./vm.h"
+#include "./analyze.h"
 #include "rjsj_test.hpp"
+bool useVM = false; //--vm：用字节码虚拟机代替树遍历求值器
+ValuePtr evaluate(ValuePtr value, std::shared_ptr<EvalEnv> env) {
+    if (useVM) return VM::instance().eval(value, std::move(env));
+    return env->eval(std::move(value));
+}
 struct TestCtx {
     std::shared_ptr<EvalEnv> env = EvalEnv::createGlobal();
     std::string eval(std::string input) {
         auto tokens = std::move(Tokenizer::tokenize(input));
         Parser parser(std::move(tokens));
         auto value = parser.parse();
-        auto result = env->eval(std::move(value));
+        auto result = evaluate(std::move(value), env);//随 --vm 切换求值器
         return result->toString();
     }
 };
@@ -74,7 +81,7 @@ void standardInput(std::shared_ptr<EvalEnv> env) {
             for (auto& expression : expressions) {
                 Parser parser(std::move(expression)); //含有一个token的deque
                 auto value = parser.parse(); //一个ValuePtr的deque
-                auto result = env->eval(std::move(value));
+                auto result = evaluate(std::move(value), env);
                 std::cout << result->toString() << std::endl; // 输出外部表示                    
             }
         } catch (std::runtime_error& e) {
@@ -107,7 +114,7 @@ void fileInput(std::ifstream& file, std::shared_ptr<EvalEnv> env) {
             for (auto& expression : expressions) {
                 Parser parser(std::move(expression)); //含有一个token的deque
                 auto value = parser.parse(); //一个ValuePtr的deque
-                auto result = env->eval(std::move(value));                   
+                auto result = evaluate(std::move(value), env);
             }
         } catch (std::runtime_error& e) {
             std::cerr << "Error: " << e.what() << std::endl;
@@ -116,17 +123,39 @@ void fileInput(std::ifstream& file, std::shared_ptr<EvalEnv> env) {
 }
 
 int main(int argc, char* argv[]) {
-    //RJSJ_TEST(TestCtx, Lv2, Lv3, Lv4, Lv5, Lv5Extra, Lv6, Lv7, Lv7Lib, Sicp);
     auto env = EvalEnv::createGlobal();
     std::ifstream file;
     int mode = 1;
+    bool test = false;          //--test：运行 rjsj_test.hpp 中课程提供的测试组
+    bool testExtensions = false;//--test-extensions：运行扩展特性的测试组
 
+    int argi = 1;
+    for (; argi < argc && std::string(argv[argi]).starts_with("--"); ++argi) {
+        std::string option = argv[argi];
+        if (option == "--vm") {
+            useVM = true;
+        } else if (option == "--no-fold") {
+            Analyzer::constantFolding = false; //关闭常量折叠，便于比较效果
+        } else if (option == "--test") {
+            test = true;
+        } else if (option == "--test-extensions") {
+            testExtensions = true;
+        } else {
+            std::cerr << "Error: Unknown option " << option << "\n";
+            std::cerr << "Usage: mini_lisp [--vm] [--no-fold] [--test | --test-extensions] [file]\n";
+            return 1;
+        }
+    }
+    //RJSJ_TEST 运行完所有测试组后以是否全部通过作为退出状态
+    if (test) RJSJ_TEST(TestCtx, Lv2, Lv3, Lv4, Lv5, Lv5Extra, Lv6, Lv7, Lv7Lib, Sicp);
+    if (testExtensions) RJSJ_TEST(TestCtx, Macro, Memo, Stream, Loop, Assign, Quasiquote, Case, GlobalCache, Jit, Inline, Closure);
     // Check if a file path was provided
-    if (argc >= 2) {
-        file.open(argv[1]);
+    if (argi < argc) {
+        file.open(argv[argi]);
         if (file) mode = 2; // Switch to file input mode
          else {
-            std::cerr << "Error: Could not open file " << argv[1] << "\n";
+            std::cerr << "Error: Could not open file " << argv[argi] << "\n";
+            std::cerr << "Usage: mini_lisp [--vm] [--no-fold] [--test | --test-extensions] [file]\n";
             return 1;
         }
     }
@@ -0,0 +1,171 @@
+#include "./memo.h"
+#include <functional>
+#include <string>
+
+namespace {
+constexpr std::size_t INITIAL_SLOTS = 16;
+//哈希只看列表的前若干个元素和有限的嵌套深度，比较时仍比较整个结构
+constexpr std::size_t MAX_HASH_ITEMS = 32;
+constexpr std::size_t MAX_HASH_DEPTH = 8;
+
+std::size_t combine(std::size_t seed, std::size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+std::size_t hashValue(Value& value, std::size_t depth) {
+    switch (value.getType()) {
+        case Type::Number: {
+            double x = static_cast<NumericValue&>(value).getVal();
+            if (x == 0) x = 0;//0 与 -0 相等，哈希也要相同
+            return std::hash<double>{}(x);
+        }
+        case Type::String:
+            return std::hash<std::string>{}(static_cast<StringValue&>(value).getVal());
+        case Type::Boolean:
+            return static_cast<BooleanValue&>(value).getVal() ? 1 : 2;
+        case Type::Nil:
+            return 3;
+        case Type::Symbol:
+            return combine(4, static_cast<SymbolValue&>(value).getId());
+        case Type::Pair: {
+            std::size_t seed = 5;
+            if (depth == 0) return seed;
+            Value* current = &value;
+            for (std::size_t i = 0; i < MAX_HASH_ITEMS && current->getType() == Type::Pair; ++i) {
+                auto& pair = static_cast<PairValue&>(*current);
+                seed = combine(seed, hashValue(*pair.getCar(), depth - 1));
+                current = pair.getCdr().get();
+            }
+            if (current->getType() != Type::Pair) seed = combine(seed, hashValue(*current, depth - 1));
+            return seed;
+        }
+        case Type::BuiltinProc:
+            return std::hash<const void*>{}(reinterpret_cast<const void*>(static_cast<BuiltinProcValue&>(value).getFunc()));
+        default:
+            //过程和存储单元按身份比较
+            return std::hash<const void*>{}(&value);
+    }
+}
+bool sameKey(const std::vector<ValuePtr>& key, std::span<const ValuePtr> args) {
+    if (key.size() != args.size()) return false;
+    for (std::size_t i = 0; i < key.size(); ++i) {
+        if (key[i] != args[i] && !key[i]->isEqual(*args[i])) return false;
+    }
+    return true;
+}
+}
+
+MemoTable::MemoTable(std::size_t limit) : limit{limit}, slots(INITIAL_SLOTS, NONE) {}
+
+std::size_t MemoTable::hash(std::span<const ValuePtr> args) {
+    std::size_t seed = args.size();
+    for (auto& arg : args) seed = combine(seed, hashValue(*arg, MAX_HASH_DEPTH));
+    return seed;
+}
+
+//返回保存着这组实参的槽位，没有时返回探测到的第一个空槽位
+std::size_t MemoTable::probe(std::size_t hash, std::span<const ValuePtr> args) const {
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = hash & mask;
+    while (slots[i] != NONE) {
+        auto& entry = entries[slots[i]];
+        if (entry.hash == hash && sameKey(entry.key, args)) break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+void MemoTable::grow() {
+    slots.assign(slots.size() * 2, NONE);
+    std::size_t mask = slots.size() - 1;
+    for (std::uint32_t index = 0; index < entries.size(); ++index) {
+        if (!entries[index].value) continue;
+        std::size_t i = entries[index].hash & mask;
+        while (slots[i] != NONE) i = (i + 1) & mask;
+        slots[i] = index;
+    }
+}
+void MemoTable::unlink(std::uint32_t index) {
+    auto& entry = entries[index];
+    if (entry.newer != NONE) entries[entry.newer].older = entry.older;
+    else newest = entry.older;
+    if (entry.older != NONE) entries[entry.older].newer = entry.newer;
+    else oldest = entry.newer;
+    entry.newer = entry.older = NONE;
+}
+void MemoTable::pushNewest(std::uint32_t index) {
+    auto& entry = entries[index];
+    entry.older = newest;
+    entry.newer = NONE;
+    if (newest != NONE) entries[newest].newer = index;
+    newest = index;
+    if (oldest == NONE) oldest = index;
+}
+void MemoTable::evictOldest() {
+    auto index = oldest;
+    unlink(index);
+    auto& entry = entries[index];
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = entry.hash & mask;
+    while (slots[i] != index) i = (i + 1) & mask;
+    //线性探测的删除：把后面探测链上的项前移填补空位，不留墓碑
+    for (std::size_t j = (i + 1) & mask; slots[j] != NONE; j = (j + 1) & mask) {
+        std::size_t home = entries[slots[j]].hash & mask;
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (stays) continue;
+        slots[i] = slots[j];
+        i = j;
+    }
+    slots[i] = NONE;
+    entry.key.clear();
+    entry.value = nullptr;
+    freeEntries.push_back(index);
+    --count;
+}
+
+ValuePtr MemoTable::find(std::size_t hash, std::span<const ValuePtr> args) {
+    auto slot = slots[probe(hash, args)];
+    if (slot == NONE) {
+        ++misses;
+        return nullptr;
+    }
+    ++hits;
+    if (limit) {
+        unlink(slot);
+        pushNewest(slot);
+    }
+    return entries[slot].value;
+}
+void MemoTable::insert(std::size_t hash, std::span<const ValuePtr> args, ValuePtr result) {
+    auto i = probe(hash, args);
+    if (slots[i] != NONE) {
+        //计算过程中递归地以相同实参调用过自身并已写入
+        entries[slots[i]].value = std::move(result);
+        if (limit) {
+            unlink(slots[i]);
+            pushNewest(slots[i]);
+        }
+        return;
+    }
+    if (limit && count >= limit) {
+        evictOldest();
+        i = probe(hash, args);
+    }
+    if ((count + 1) * 2 > slots.size()) {
+        grow();
+        i = probe(hash, args);
+    }
+    std::uint32_t index;
+    if (!freeEntries.empty()) {
+        index = freeEntries.back();
+        freeEntries.pop_back();
+    } else {
+        index = static_cast<std::uint32_t>(entries.size());
+        entries.emplace_back();
+    }
+    auto& entry = entries[index];
+    entry.hash = hash;
+    entry.key.assign(args.begin(), args.end());
+    entry.value = std::move(result);
+    slots[i] = index;
+    ++count;
+    if (limit) pushNewest(index);
+}
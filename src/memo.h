@@ -0,0 +1,62 @@
+#ifndef MEMO_H
+#define MEMO_H
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "./value.h"
+
+//记忆化过程的结果缓存。
+//以实参的结构哈希为键的开放定址（线性探测）哈希表，实参按 equal? 比较。
+//设置了容量上限时，表满后淘汰最久未被使用的项。
+class MemoTable {
+    static constexpr std::uint32_t NONE = UINT32_MAX;
+    struct Entry {
+        std::size_t hash;
+        std::vector<ValuePtr> key;
+        ValuePtr value;
+        std::uint32_t newer = NONE;//有上限时的 LRU 双向链表
+        std::uint32_t older = NONE;
+    };
+    std::size_t limit;//0 表示不限制
+    std::vector<Entry> entries;//项的下标在其生命期内不变，槽位中保存下标
+    std::vector<std::uint32_t> freeEntries;//被淘汰的项留下的空位
+    std::vector<std::uint32_t> slots;
+    std::size_t count = 0;
+    std::uint32_t newest = NONE;
+    std::uint32_t oldest = NONE;
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t probe(std::size_t hash, std::span<const ValuePtr> args) const;
+    void grow();
+    void unlink(std::uint32_t index);
+    void pushNewest(std::uint32_t index);
+    void evictOldest();
+public:
+    explicit MemoTable(std::size_t limit);
+    //实参的结构哈希：equal? 的两组实参哈希值相同
+    static std::size_t hash(std::span<const ValuePtr> args);
+    //命中时返回缓存的结果，否则返回空指针
+    ValuePtr find(std::size_t hash, std::span<const ValuePtr> args);
+    void insert(std::size_t hash, std::span<const ValuePtr> args, ValuePtr result);
+    std::size_t getHits() const {
+        return hits;
+    }
+    std::size_t getMisses() const {
+        return misses;
+    }
+    std::size_t size() const {
+        return count;
+    }
+    //供回收器遍历表中引用的值
+    template <typename F>
+    void forEach(F&& visit) const {
+        for (auto& entry : entries) {
+            if (!entry.value) continue;
+            for (auto& arg : entry.key) visit(arg);
+            visit(entry.value);
+        }
+    }
+};
+
+#endif
@@ -9,11 +9,11 @@ ValuePtr Parser::parse(){
     tokens.pop_front();
     if (token->getType() == TokenType::NUMERIC_LITERAL) {
         auto value = static_cast<NumericLiteralToken&>(*token).getValue();
-        return std::make_shared<NumericValue>(value);
+        return NumericValue::create(value);
     }
     else if (token->getType() == TokenType::BOOLEAN_LITERAL) {
         auto value = static_cast<BooleanLiteralToken&>(*token).getValue();
-        return std::make_shared<BooleanValue>(value);
+        return BooleanValue::create(value);
     }
     else if (token->getType() == TokenType::STRING_LITERAL) {
         auto value = static_cast<StringLiteralToken&>(*token).getValue();
@@ -21,35 +21,44 @@ ValuePtr Parser::parse(){
     }
     else if (token->getType() == TokenType::IDENTIFIER) {
         auto name = static_cast<IdentifierToken&>(*token).getName();
-        return std::make_shared<SymbolValue>(name);
+        return SymbolValue::intern(name);
     }
     else if (token->getType() == TokenType::LEFT_PAREN) {
         return parseTails();
     }
     else if (token->getType() == TokenType::QUOTE) {
-        return std::make_shared<PairValue>(
-            std::make_shared<SymbolValue>("quote"),
-            std::make_shared<PairValue>(
+        return PairValue::create(
+            SymbolValue::intern("quote"),
+            PairValue::create(
                 this->parse(),
-                std::make_shared<NilValue>()
+                NilValue::create()
             )
         );
     }
     else if (token->getType() == TokenType::QUASIQUOTE) {
-        return std::make_shared<PairValue>(
-            std::make_shared<SymbolValue>("quasiquote"),
-            std::make_shared<PairValue>(
+        return PairValue::create(
+            SymbolValue::intern("quasiquote"),
+            PairValue::create(
                 this->parse(),
-                std::make_shared<NilValue>()
+                NilValue::create()
             )
         );
     }
     else if (token->getType() == TokenType::UNQUOTE) {
-        return std::make_shared<PairValue>(
-            std::make_shared<SymbolValue>("unquote"),
-            std::make_shared<PairValue>(
+        return PairValue::create(
+            SymbolValue::intern("unquote"),
+            PairValue::create(
                 this->parse(),
-                std::make_shared<NilValue>()
+                NilValue::create()
+            )
+        );
+    }
+    else if (token->getType() == TokenType::UNQUOTE_SPLICING) {
+        return PairValue::create(
+            SymbolValue::intern("unquote-splicing"),
+            PairValue::create(
+                this->parse(),
+                NilValue::create()
             )
         );
     }
@@ -60,7 +69,7 @@ ValuePtr Parser::parseTails() {
     if (tokens.empty()) throw SyntaxError("missing token");
     if (tokens.front()->getType() == TokenType::RIGHT_PAREN) {
         tokens.pop_front();
-        return std::make_shared<NilValue>();
+        return NilValue::create();
     }
     auto car = this->parse();
     if (tokens.empty()) throw SyntaxError("missing )");
@@ -69,9 +78,9 @@ ValuePtr Parser::parseTails() {
         auto cdr = this->parse();
         if (tokens.empty()) throw SyntaxError("missing )");
         tokens.pop_front();//再弹出一个词法标记，它应当是 ')';
-        return std::make_shared<PairValue>(car, cdr);
+        return PairValue::create(car, cdr);
     } else {
         auto cdr = this->parseTails();
-        return std::make_shared<PairValue>(car, cdr);
+        return PairValue::create(car, cdr);
     }
 }
@@ -11,6 +11,9 @@ class Parser {
 public:
     Parser(std::deque<TokenPtr> tokens);
     ValuePtr parse();
+    bool empty() const {
+        return tokens.empty();
+    }
     ValuePtr parseTails();
 };
     
@@ -0,0 +1,99 @@
+#ifndef POOL_H
+#define POOL_H
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+//定长块的线程局部内存池。
+//新块从当前大块中按指针递增切出；释放的块挂进空闲链表，下一次分配优先复用。
+//短命对象（求值中途构造的对子、一次调用的环境）因此几乎不经过 malloc，
+//且刚释放的块马上被复用，始终落在缓存热区。
+template <std::size_t Size, std::size_t Align>
+class FixedPool {
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    static constexpr std::size_t BLOCK_ALIGN = Align > alignof(FreeBlock) ? Align : alignof(FreeBlock);
+    static constexpr std::size_t BLOCK_SIZE =
+        (std::max(Size, sizeof(FreeBlock)) + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+    static constexpr std::size_t BLOCKS_PER_CHUNK = 1024;
+
+    FreeBlock* freeList = nullptr;
+    std::byte* cursor = nullptr;
+    std::byte* limit = nullptr;
+    std::vector<std::byte*> chunks;
+    std::size_t outstanding = 0;
+
+    FixedPool() = default;
+    ~FixedPool() {
+        //线程退出时仍有对象存活（例如被静态变量持有），则放弃归还，避免悬垂
+        if (outstanding) return;
+        for (auto chunk : chunks) {
+            ::operator delete(chunk, std::align_val_t{BLOCK_ALIGN});
+        }
+    }
+
+public:
+    FixedPool(const FixedPool&) = delete;
+    FixedPool& operator=(const FixedPool&) = delete;
+
+    static FixedPool& instance() {
+        thread_local FixedPool pool;
+        return pool;
+    }
+    void* allocate() {
+        ++outstanding;
+        if (freeList) {
+            auto block = freeList;
+            freeList = block->next;
+            return block;
+        }
+        if (cursor == limit) {
+            cursor = static_cast<std::byte*>(
+                ::operator new(BLOCK_SIZE * BLOCKS_PER_CHUNK, std::align_val_t{BLOCK_ALIGN}));
+            limit = cursor + BLOCK_SIZE * BLOCKS_PER_CHUNK;
+            chunks.push_back(cursor);
+        }
+        auto block = cursor;
+        cursor += BLOCK_SIZE;
+        return block;
+    }
+    void deallocate(void* ptr) {
+        --outstanding;
+        auto block = static_cast<FreeBlock*>(ptr);
+        block->next = freeList;
+        freeList = block;
+    }
+};
+
+//供 std::allocate_shared 使用的分配器：对象与控制块一起从 FixedPool 中取
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        if (n != 1) {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{alignof(T)}));
+        }
+        return static_cast<T*>(FixedPool<sizeof(T), alignof(T)>::instance().allocate());
+    }
+    void deallocate(T* ptr, std::size_t n) {
+        if (n != 1) {
+            ::operator delete(ptr, std::align_val_t{alignof(T)});
+            return;
+        }
+        FixedPool<sizeof(T), alignof(T)>::instance().deallocate(ptr);
+    }
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const {
+        return true;
+    }
+};
+
+#endif
@@ -1128,6 +1128,264 @@ RMLT_CASE("(define (len s) (if (eq? s '()) 0 (+ 1 (len (cdr s)))))")
 RMLT_CASE("(len '(1 2 3 4))", "4")
 RMLT_END_CASES()
 
+// 以下测试组覆盖 mini_lisp 的扩展特性，由 mini_lisp --test-extensions 运行
+
+RMLT_BEGIN_CASES(Macro)
+RMLT_CASE("(define-macro (my-unless c . body) (list 'if c ''() (cons 'begin body)))")
+RMLT_CASE("(my-unless #f 1 2 3)", "3")
+RMLT_CASE("(my-unless #t 1)", "()")
+RMLT_CASE("(define-macro (my-or2 a b) `(let ((t ,a)) (if t t ,b)))")
+RMLT_CASE("(define (f x) (my-or2 (> x 10) 'small))")
+RMLT_CASE("(f 5)", "small")
+RMLT_CASE("(f 50)", "#t")
+RMLT_CASE("(define-macro (make-adder n) `(lambda (x) (+ x ,n)))")
+RMLT_CASE("((make-adder 5) 10)", "15")
+RMLT_CASE("(define-macro (swap! a b) `(let ((tmp ,a)) (set! ,a ,b) (set! ,b tmp)))")
+RMLT_CASE("(define p 1)")
+RMLT_CASE("(define q 2)")
+RMLT_CASE("(swap! p q)")
+RMLT_CASE("(list p q)", "(2 1)")
+// 重定义宏后，同一个表被再次 eval 时不能命中旧的展开缓存
+RMLT_CASE("(define-macro (inc x) `(+ ,x 1))")
+RMLT_CASE("(define form '(inc 41))")
+RMLT_CASE("(eval form)", "42")
+RMLT_CASE("(eval form)", "42")
+RMLT_CASE("(define (g) (inc 1))")
+RMLT_CASE("(g)", "2")
+RMLT_CASE("(define-macro (inc x) `(- ,x 1))")
+RMLT_CASE("(eval form)", "40")
+RMLT_CASE("(inc 41)", "40")
+// 已分析的过程体保存的是展开结果，重新定义后才使用新宏
+RMLT_CASE("(g)", "2")
+RMLT_CASE("(define (g) (inc 1))")
+RMLT_CASE("(g)", "0")
+RMLT_END_CASES()
+
+RMLT_BEGIN_CASES(Memo)
+RMLT_CASE("(define calls 0)")
+RMLT_CASE("(define (slow-square x) (set! calls (+ calls 1)) (* x x))")
+RMLT_CASE("(define square (memoize slow-square 2))")
+RMLT_CASE("(square 3)", "9")
+RMLT_CASE("(square 3)", "9")
+RMLT_CASE("calls", "1")
+RMLT_CASE("(memo-stats square)", "(1 1 1)")
+// 容量为 2，加入 5 时淘汰最久未使用的 3
+RMLT_CASE("(square 4)", "16")
+RMLT_CASE("(square 5)", "25")
+RMLT_CASE("(memo-stats square)", "(1 3 2)")
+RMLT_CASE("(square 4)", "16")
+RMLT_CASE("(square 3)", "9")
+RMLT_CASE("calls", "4")
+RMLT_CASE("(memo-stats square)", "(2 4 2)")
+// 递归调用同样经过缓存
+RMLT_CASE("(define-memoized (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))")
+RMLT_CASE("(fib 60)", "1548008755920")
+RMLT_CASE("(memo-stats fib)", "(58 61 61)")
+// 参数按 equal? 比较
+RMLT_CASE("(define len (memoize (lambda (l) (length l))))")
+RMLT_CASE("(len '(1 2 3))", "3")
+RMLT_CASE("(len (list 1 2 3))", "3")
+RMLT_CASE("(memo-stats len)", "(1 1 1)")
+RMLT_END_CASES()
+
+RMLT_BEGIN_CASES(Stream)
+// delay 的表达式只求值一次
+RMLT_CASE("(define count 0)")
+RMLT_CASE("(define p (delay (begin (set! count (+ count 1)) count)))")
+RMLT_CASE("count", "0")
+RMLT_CASE("(force p)", "1")
+RMLT_CASE("(force p)", "1")
+RMLT_CASE("count", "1")
+RMLT_CASE("(force 5)", "5")
+RMLT_CASE("(define (ints n) (cons-stream n (ints (+ n 1))))")
+RMLT_CASE("(define nat (ints 0))")
+RMLT_CASE("(stream-car (stream-cdr nat))", "1")
+RMLT_CASE("(stream-take nat 5)", "(0 1 2 3 4)")
+RMLT_CASE("(stream-take (stream-map (lambda (x) (* x x)) nat) 5)", "(0 1 4 9 16)")
+RMLT_CASE("(stream-take (stream-filter odd? nat) 5)", "(1 3 5 7 9)")
+RMLT_CASE("(stream-take '(1 2 3) 5)", "(1 2 3)")
+RMLT_CASE("(define (sieve s) (cons-stream (stream-car s) (sieve (stream-filter (lambda (x) (not (= 0 (remainder x (stream-car s))))) (stream-cdr s)))))")
+RMLT_CASE("(stream-take (sieve (ints 2)) 10)", "(2 3 5 7 11 13 17 19 23 29)")
+// 尾部的 promise 被强制后缓存，再次遍历不会重新计算
+RMLT_CASE("(define evaluated 0)")
+RMLT_CASE("(define (counted n) (cons-stream n (begin (set! evaluated (+ evaluated 1)) (counted (+ n 1)))))")
+RMLT_CASE("(define s (counted 0))")
+RMLT_CASE("(stream-take s 4)", "(0 1 2 3)")
+RMLT_CASE("(stream-take s 4)", "(0 1 2 3)")
+RMLT_CASE("evaluated", "3")
+RMLT_END_CASES()
+
+RMLT_BEGIN_CASES(Loop)
+RMLT_CASE("(let loop ((i 0) (acc 0)) (if (< i 100000) (loop (+ i 1) (+ acc i)) acc))", "4999950000")
+RMLT_CASE("(do ((i 0 (+ i 1)) (acc 0 (+ acc i))) ((= i 100000) acc))", "4999950000")
+RMLT_CASE("(do ((vec '() (cons i vec)) (i 0 (+ i 1))) ((= i 5) vec))", "(4 3 2 1 0)")
+RMLT_CASE("(define (count-up n) (let loop ((i n) (r '())) (cond ((= i 0) r) (else (loop (- i 1) (cons i r))))))")
+RMLT_CASE("(count-up 5)", "(1 2 3 4 5)")
+// 非尾位置的自调用不能改写成循环
+RMLT_CASE("(define (depth n) (let loop ((i 0)) (if (< i n) (+ 1 (loop (+ i 1))) 0)))")
+RMLT_CASE("(depth 100)", "100")
+RMLT_CASE("(define (nested n m) (let outer ((i 0) (acc 0)) (if (< i n) (let inner ((j 0) (acc acc)) (if (< j m) (inner (+ j 1) (+ acc 1)) (outer (+ i 1) acc))) acc)))")
+RMLT_CASE("(nested 30 100)", "3000")
+// 逃出循环的闭包保留各自那一轮的绑定
+RMLT_CASE("(define (closures n) (let loop ((i 0) (fs '())) (if (< i n) (loop (+ i 1) (cons (lambda () i) fs)) (map (lambda (f) (f)) fs))))")
+RMLT_CASE("(closures 5)", "(4 3 2 1 0)")
+RMLT_CASE("(define (do-closures n) (do ((i 0 (+ i 1)) (fs '() (cons (lambda () i) fs))) ((= i n) (map (lambda (f) (f)) fs))))")
+RMLT_CASE("(do-closures 5)", "(4 3 2 1 0)")
+RMLT_CASE("(define (escape) (let loop ((i 0)) loop))")
+RMLT_CASE("(procedure? (escape))", "#t")
+RMLT_CASE("(let loop ((i 0)) (and (< i 10) (or (= i 7) (loop (+ i 1)))))", "#t")
+RMLT_END_CASES()
+
+RMLT_BEGIN_CASES(Assign)
+RMLT_CASE("(define g 10)")
+RMLT_CASE("(set! g (* g 2))")
+RMLT_CASE("g", "20")
+// 未被捕获的局部变量直接写回帧
+RMLT_CASE("(define (triple x) (set! x (* x 3)) x)")
+RMLT_CASE("(triple 7)", "21")
+RMLT_CASE("(define (tick n) (let ((k n)) (set! k (- k 1)) (if (> k 0) (tick k) k)))")
+RMLT_CASE("(tick 200)", "0")
+RMLT_CASE("(define (sum-to n) (let ((total 0) (i 0)) (do () ((= i n) total) (set! total (+ total i)) (set! i (+ i 1)))))")
+RMLT_CASE("(sum-to 100)", "4950")
+// 被闭包捕获的局部变量，闭包与定义它的过程看到同一个绑定
+RMLT_CASE("(define (make-counter) (let ((n 0)) (lambda () (set! n (+ n 1)) n)))")
+RMLT_CASE("(define c1 (make-counter))")
+RMLT_CASE("(define c2 (make-counter))")
+RMLT_CASE("(c1)", "1")
+RMLT_CASE("(c1)", "2")
+RMLT_CASE("(c2)", "1")
+RMLT_CASE("(define (shared) (let ((x 1)) (let ((get (lambda () x)) (put (lambda (v) (set! x v)))) (put 42) (list (get) x))))")
+RMLT_CASE("(shared)", "(42 42)")
+RMLT_CASE("(define (param-captured y) (define (peek) y) (set! y (+ y 1)) (peek))")
+RMLT_CASE("(param-captured 5)", "6")
+RMLT_CASE("(define (sum-list lst) (let ((acc 0)) (define (walk l) (if (null? l) acc (begin (set! acc (+ acc (car l))) (walk (cdr l))))) (walk lst)))")
+RMLT_CASE("(sum-list '(1 2 3 4 5))", "15")
+RMLT_CASE("(define (box-in-loop) (let loop ((i 0) (fs '())) (if (= i 3) (map (lambda (f) (f)) fs) (let ((k i)) (loop (+ i 1) (cons (lambda () (set! k (* k 10)) k) fs))))))")
+RMLT_CASE("(box-in-loop)", "(20 10 0)")
+// 通过 eval 修改的局部变量
+RMLT_CASE("(define (via-eval x) (eval '(set! x 9)) x)")
+RMLT_CASE("(via-eval 1)", "9")
+RMLT_END_CASES()
+
+RMLT_BEGIN_CASES(Quasiquote)
+RMLT_CASE("(define x 5)")
+RMLT_CASE("(define lst '(1 2 3))")
+RMLT_CASE("`(a b ,x)", "(a b 5)")
+RMLT_CASE("`(a ,@lst b)", "(a 1 2 3 b)")
+RMLT_CASE("`(,@lst ,@lst)", "(1 2 3 1 2 3)")
+RMLT_CASE("`(a . ,x)", "(a . 5)")
+RMLT_CASE("`((nested ,x) (const list) ,@'() end)", "((nested 5) (const list) end)")
+RMLT_CASE("`(1 ,@(map (lambda (n) (* n n)) lst) . tail)", "(1 1 4 9 . tail)")
+RMLT_CASE("`x", "x")
+RMLT_CASE("`,x", "5")
+RMLT_CASE("`(1 `(2 ,(3 ,x)))", "(1 (quasiquote (2 (unquote (3 5)))))")
+// 末尾的 ,@ 直接共享被拼接的表，不含 unquote 的子结构只构造一次
+RMLT_CASE("(eq? `(,@lst) lst)", "#t")
+RMLT_CASE("(define (g y) `(const (deep tree) ,y))")
+RMLT_CASE("(eq? (car (cdr (g 1))) (car (cdr (g 2))))", "#t")
+RMLT_CASE("(g 7)", "(const (deep tree) 7)")
+RMLT_END_CASES()
+
+RMLT_BEGIN_CASES(Case)
+RMLT_CASE("(define (classify x) (case x ((1 2 3) 'small) ((4 5 6) 'medium) ((a e i o u) 'vowel) ((#t) 'true) ((()) 'empty) ((1 a) 'never) (else 'other)))")
+RMLT_CASE("(classify 2)", "small")
+RMLT_CASE("(classify 5)", "medium")
+RMLT_CASE("(classify 'e)", "vowel")
+RMLT_CASE("(classify #t)", "true")
+RMLT_CASE("(classify '())", "empty")
+// 同一个 datum 出现在多个子句中时取靠前的子句
+RMLT_CASE("(classify 1)", "small")
+RMLT_CASE("(classify 'a)", "vowel")
+RMLT_CASE("(classify 'z)", "other")
+RMLT_CASE("(classify \"s\")", "other")
+RMLT_CASE("(case -0 ((0) 'zero) (else 'nonzero))", "zero")
+RMLT_CASE("(case (* 2 3) ((2 3 5 7) 'prime) ((1 4 6 8 9) 'composite))", "composite")
+RMLT_CASE("(case 'banana ((apple) 1) ((banana) 'b 2) (else 3))", "2")
+// 子句体处于尾位置，命名 let 经 case 分派仍是循环
+RMLT_CASE("(define (run prog) (let loop ((p prog) (acc 0)) (if (null? p) acc (case (car p) ((inc) (loop (cdr p) (+ acc 1))) ((dec) (loop (cdr p) (- acc 1))) ((dbl) (loop (cdr p) (* acc 2))) (else (loop (cdr p) acc))))))")
+RMLT_CASE("(run '(inc inc dbl dec nop))", "3")
+RMLT_END_CASES()
+
+RMLT_BEGIN_CASES(GlobalCache)
+// 全局变量结点缓存了绑定所在的单元，之后被局部 define 遮蔽或被重新定义时必须看到新绑定
+RMLT_CASE("(define z 1)")
+RMLT_CASE("(define (g flag) (if flag (eval '(define z 100))) z)")
+RMLT_CASE("(g #f)", "1")
+RMLT_CASE("(g #t)", "100")
+RMLT_CASE("(g #f)", "1")
+RMLT_CASE("z", "1")
+RMLT_CASE("(define z 2)")
+RMLT_CASE("(g #f)", "2")
+RMLT_CASE("(define (first x) (car x))")
+RMLT_CASE("(first '(1 2))", "1")
+RMLT_CASE("(define (shadowed x) (eval '(define car cdr)) (car x))")
+RMLT_CASE("(shadowed '(1 2))", "(2)")
+RMLT_CASE("(first '(1 2))", "1")
+RMLT_CASE("(define car cdr)")
+RMLT_CASE("(first '(1 2))", "(2)")
+RMLT_END_CASES()
+
+RMLT_BEGIN_CASES(Jit)
+// 调用次数超过 JitState::THRESHOLD 后过程被编译成机器码，之后改变它依赖的全局绑定要回到解释器
+RMLT_CASE("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))")
+RMLT_CASE("(fib 20)", "6765")
+RMLT_CASE("(fib 20)", "6765")
+RMLT_CASE("(define old-fib fib)")
+RMLT_CASE("(define (fib n) n)")
+RMLT_CASE("(old-fib 20)", "37")
+RMLT_CASE("(fib 20)", "20")
+RMLT_CASE("(define (pow b e) (if (= e 0) 1 (* b (pow b (- e 1)))))")
+RMLT_CASE("(pow 1 1500)", "1")
+RMLT_CASE("(pow 2 10)", "1024")
+RMLT_CASE("(pow 2.5 2)", "6.25")
+RMLT_CASE("(define * +)")
+RMLT_CASE("(pow 2 10)", "21")
+RMLT_CASE("(pow 1 1500)", "1501")
+// 实参不是数时这次调用由解释器执行
+RMLT_CASE("(pow 'x 0)", "1")
+RMLT_END_CASES()
+
+RMLT_BEGIN_CASES(Inline)
+// 小过程在调用点内联，之后用 define 或 set! 改变它的绑定，调用点必须改用新的过程
+RMLT_CASE("(define (square x) (* x x))")
+RMLT_CASE("(define (average a b) (/ (+ a b) 2))")
+RMLT_CASE("(define (f i) (average (square i) i))")
+RMLT_CASE("(define (loop i acc) (if (< i 100) (loop (+ i 1) (+ acc (f i))) acc))")
+RMLT_CASE("(loop 0 0)", "166650")
+RMLT_CASE("(f 4)", "10")
+RMLT_CASE("(define (square x) (+ x x))")
+RMLT_CASE("(f 4)", "6")
+RMLT_CASE("(set! square (lambda (x) (- x)))")
+RMLT_CASE("(f 4)", "0")
+// 换成实参个数不同的过程或内置过程时，退回普通调用
+RMLT_CASE("(define (square x y) (* x y))")
+RMLT_CASE("(define (g i) (square i 3))")
+RMLT_CASE("(g 5)", "15")
+RMLT_CASE("(set! square *)")
+RMLT_CASE("(g 5)", "15")
+RMLT_CASE("(f 4)", "4")
+RMLT_CASE("(define (t) (square 5))")
+RMLT_CASE("(t)", "5")
+RMLT_CASE("(define (square x) 'redefined)")
+RMLT_CASE("(t)", "redefined")
+RMLT_END_CASES()
+
+RMLT_BEGIN_CASES(Closure)
+RMLT_CASE("(define (adder n) (lambda (x) (+ x n)))")
+RMLT_CASE("((adder 2) 3)", "5")
+// 函数体中有 eval 的闭包保留整条环境链，eval 能按名字找到外层的局部变量
+RMLT_CASE("(define (f x) ((lambda () (eval 'x))))")
+RMLT_CASE("(f 5)", "5")
+RMLT_CASE("(define (g x) (lambda () (eval '(+ x 1))))")
+RMLT_CASE("((g 41))", "42")
+RMLT_CASE("(define (h x) (let ((y (* x 2))) ((lambda () (eval '(list x y))))))")
+RMLT_CASE("(h 3)", "(3 6)")
+RMLT_CASE("(define (k x) (define (inner) (eval 'x)) (set! x 10) (inner))")
+RMLT_CASE("(k 1)", "10")
+RMLT_CASE("(define (nest x) (lambda () (lambda () (eval 'x))))")
+RMLT_CASE("(((nest 7)))", "7")
+RMLT_END_CASES()
+
 #undef RMLT_BEGIN_CASES
 #undef RMLT_CASE
 #undef RMLT_END_CASES
@@ -23,6 +23,10 @@ TokenPtr Token::dot() {
     return TokenPtr(new Token(TokenType::DOT));
 }
 
+TokenPtr Token::unquoteSplicing() {
+    return TokenPtr(new Token(TokenType::UNQUOTE_SPLICING));
+}
+
 std::string Token::toString() const {
     switch (type) {
         case TokenType::LEFT_PAREN: return "(LEFT_PAREN)"; break;
@@ -30,6 +34,7 @@ std::string Token::toString() const {
         case TokenType::QUOTE: return "(QUOTE)"; break;
         case TokenType::QUASIQUOTE: return "(QUASIQUOTE)"; break;
         case TokenType::UNQUOTE: return "(UNQUOTE)"; break;
+        case TokenType::UNQUOTE_SPLICING: return "(UNQUOTE_SPLICING)"; break;
         case TokenType::DOT: return "(DOT)"; break;
         default: return "(UNKNOWN)";
     }
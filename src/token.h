@@ -12,6 +12,7 @@ enum class TokenType {
     QUOTE,
     QUASIQUOTE,
     UNQUOTE,
+    UNQUOTE_SPLICING,
     DOT,
     BOOLEAN_LITERAL,
     NUMERIC_LITERAL,
@@ -34,6 +35,7 @@ public:
 
     static TokenPtr fromChar(char c);
     static TokenPtr dot();
+    static TokenPtr unquoteSplicing();
 
     TokenType getType() const {
         return type;
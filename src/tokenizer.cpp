@@ -28,6 +28,9 @@ TokenPtr Tokenizer::nextToken(int& pos) {
             }
         } else if (std::isspace(c)) {
             pos++;
+        } else if (c == ',' && pos + 1 < input.size() && input[pos + 1] == '@') {
+            pos += 2;
+            return Token::unquoteSplicing();
         } else if (auto token = Token::fromChar(c)) {
             pos++;
             return token;
@@ -1,23 +1,102 @@
 #include "./value.h"
 #include "./error.h"
+#include "./pool.h"
+#include "./analyze.h"
+#include "./vm.h"
+#include "./jit.h"
+#include "./memo.h"
 #include <iomanip>
 #include <sstream>
 #include <vector>
 #include <iostream>
+#include <unordered_map>
 
 //构造函数
-Value::Value(){}
+Value::Value(Type type): type{type} {}
 Value::~Value(){}
-BooleanValue::BooleanValue(const bool& val): Value(), val{val} {}
-NumericValue::NumericValue(const double& val): Value(), val{val} {}
-StringValue::StringValue(const std::string& val): Value(), val{val} {}
-NilValue::NilValue(): Value() {}
-SymbolValue::SymbolValue(const std::string& symbol): Value(), symbol{symbol} {}
-PairValue::PairValue(const std::shared_ptr<Value>& left, const std::shared_ptr<Value>& right): Value(), left{left}, right{right} {}
+BooleanValue::BooleanValue(const bool& val): Value(Type::Boolean), val{val} {}
+NumericValue::NumericValue(const double& val): Value(Type::Number), val{val} {}
+StringValue::StringValue(const std::string& val): Value(Type::String), val{val} {}
+NilValue::NilValue(): Value(Type::Nil) {}
+SymbolValue::SymbolValue(const std::string& symbol, SymbolId id): Value(Type::Symbol), symbol{symbol}, id{id} {}
+PairValue::PairValue(const std::shared_ptr<Value>& left, const std::shared_ptr<Value>& right): Value(Type::Pair), left{left}, right{right} {}
 using ValuePtr = std::shared_ptr<Value>;
-using BuiltinFuncType = ValuePtr(const std::vector<ValuePtr>&, EvalEnv&);
-BuiltinProcValue::BuiltinProcValue(BuiltinFuncType* func) : Value(), func(func) {}
-LambdaValue::LambdaValue(const std::vector<std::string>& params, const std::vector<ValuePtr>& body, std::shared_ptr<EvalEnv> initEnv) : params{params}, body{body}, initEnv{initEnv} {}
+BoxValue::BoxValue(ValuePtr value): Value(Type::Box), value{std::move(value)} {}
+PromiseValue::PromiseValue(ValuePtr proc, std::vector<ValuePtr> args): Value(Type::Promise), proc{std::move(proc)}, args{std::move(args)} {}
+PromiseValue::~PromiseValue() {
+    //已求值的长流是 对子 -> 承诺 -> 对子 ... 的链，逐节拆开再释放，避免析构递归过深
+    ValuePtr next = std::move(value);
+    while (next && next.use_count() == 1 && next->getType() == Type::Pair) {
+        auto& pair = static_cast<PairValue&>(*next);
+        auto tail = pair.getCdr();
+        if (tail->getType() != Type::Promise || tail.use_count() != 2) break;
+        pair.setCdr(nullptr);
+        next = std::move(static_cast<PromiseValue&>(*tail).value);
+    }
+}
+BuiltinProcValue::BuiltinProcValue(BuiltinFuncType* func, int minArgs, int maxArgs, UnaryFuncType* unary, BinaryFuncType* binary)
+    : Value(Type::BuiltinProc), func{func}, minArgs{minArgs}, maxArgs{maxArgs}, unary{unary}, binary{binary} {}
+LambdaValue::LambdaValue(FrameLayoutPtr layout, std::size_t arity, std::shared_ptr<const std::vector<NodePtr>> body, std::shared_ptr<EvalEnv> initEnv, std::shared_ptr<JitState> jit, std::shared_ptr<const InlineBody> inlined, bool reuseFrames) : Value(Type::Lambda), layout{std::move(layout)}, arity{arity}, body{std::move(body)}, initEnv{std::move(initEnv)}, jit{std::move(jit)}, inlined{std::move(inlined)}, reuseFrames{reuseFrames} {}
+LambdaValue::LambdaValue(FrameLayoutPtr params, std::shared_ptr<const Chunk> code, std::shared_ptr<EvalEnv> initEnv) : Value(Type::Lambda), layout{std::move(params)}, arity{layout->size()}, code{std::move(code)}, initEnv{std::move(initEnv)} {}
+
+//不可变的立即值：布尔、空表和小整数都复用共享实例，避免每次运算都分配内存
+ValuePtr BooleanValue::create(bool val) {
+    static const ValuePtr trueValue = std::make_shared<BooleanValue>(true);
+    static const ValuePtr falseValue = std::make_shared<BooleanValue>(false);
+    return val ? trueValue : falseValue;
+}
+ValuePtr NilValue::create() {
+    static const ValuePtr nil = std::make_shared<NilValue>();
+    return nil;
+}
+//全局符号表。用函数内静态变量，保证其他翻译单元的静态初始化也能安全地驻留符号
+namespace {
+struct SymbolTable {
+    std::unordered_map<std::string, std::shared_ptr<SymbolValue>> byName;
+    std::vector<SymbolValue*> byId;
+};
+SymbolTable& symbolTable() {
+    static SymbolTable table;
+    return table;
+}
+}
+std::shared_ptr<SymbolValue> SymbolValue::intern(const std::string& symbol) {
+    auto& table = symbolTable();
+    auto it = table.byName.find(symbol);
+    if (it != table.byName.end()) return it->second;
+    auto value = std::make_shared<SymbolValue>(symbol, SymbolId(table.byId.size()));
+    table.byId.push_back(value.get());
+    table.byName.emplace(symbol, value);
+    return value;
+}
+const std::string& SymbolValue::nameOf(SymbolId id) {
+    return symbolTable().byId.at(id)->getVal();
+}
+ValuePtr BoxValue::create(ValuePtr value) {
+    return std::make_shared<BoxValue>(std::move(value));
+}
+ValuePtr PromiseValue::create(ValuePtr proc, std::vector<ValuePtr> args) {
+    return std::make_shared<PromiseValue>(std::move(proc), std::move(args));
+}
+ValuePtr PairValue::create(const ValuePtr& left, const ValuePtr& right) {
+    return std::allocate_shared<PairValue>(PoolAllocator<PairValue>(), left, right);
+}
+constexpr int SMALL_INT_MIN = -128;
+constexpr int SMALL_INT_MAX = 1023;
+ValuePtr NumericValue::create(double val) {
+    static const std::vector<ValuePtr> smallInts = [] {
+        std::vector<ValuePtr> cache;
+        for (int i = SMALL_INT_MIN; i <= SMALL_INT_MAX; ++i) {
+            cache.push_back(std::make_shared<NumericValue>(i));
+        }
+        return cache;
+    }();
+    //NaN 不满足任何比较，会直接落到新建分支
+    if (val >= SMALL_INT_MIN && val <= SMALL_INT_MAX && val == int(val)) {
+        return smallInts[int(val) - SMALL_INT_MIN];
+    }
+    return std::make_shared<NumericValue>(val);
+}
 
 //toString函数
 std::string BooleanValue::toString() const {
@@ -41,16 +120,13 @@ std::string SymbolValue::toString() const {
 }
 std::string PairValue::toString() const {
     std::string res = left->toString();
-    PairValue* rightIsPair = dynamic_cast<PairValue*>(right.get());
-    NilValue* rightIsNil = dynamic_cast<NilValue*>(right.get());
-    auto nextRight = right;
-    while (rightIsPair) {
-        res += " " + rightIsPair->left->toString();
-        nextRight = rightIsPair->right;
-        rightIsPair = dynamic_cast<PairValue*>(nextRight.get());
-        rightIsNil = dynamic_cast<NilValue*>(nextRight.get());
-    }
-    if (rightIsNil) {}//空表不增加输出
+    const Value* nextRight = right.get();
+    while (nextRight->getType() == Type::Pair) {
+        auto rightPair = static_cast<const PairValue*>(nextRight);
+        res += " " + rightPair->left->toString();
+        nextRight = rightPair->right.get();
+    }
+    if (nextRight->getType() == Type::Nil) {}//空表不增加输出
     else {
         res += " . " + nextRight->toString();
     }
@@ -62,106 +138,180 @@ std::string BuiltinProcValue::toString() const {
 std::string LambdaValue::toString() const {
     return "#<procedure>";
 }
+std::string BoxValue::toString() const {
+    return "#<box>";
+}
+std::string PromiseValue::toString() const {
+    return "#<promise>";
+}
 
 //is/as函数
 bool Value::isList() {
-    if (typeid(*this) == typeid(NilValue)) return true;
-    if (auto pair = dynamic_cast<PairValue*>(this)) {
-        if (pair->getCdr()->isList()) return true;
+    //沿 cdr 迭代，避免长列表递归
+    const Value* current = this;
+    while (current->type == Type::Pair) {
+        current = static_cast<const PairValue*>(current)->right.get();
     }
-    return false;
+    return current->type == Type::Nil;
 }
 bool Value::isNil() {
-    if(dynamic_cast<NilValue*>(this)) return true;
-    return false;
+    return type == Type::Nil;
 }
 bool Value::isNumber() {
-    if(dynamic_cast<NumericValue*>(this)) return true;
-    return false;
+    return type == Type::Number;
 }
 double Value::asNumber() {
-    NumericValue* num = dynamic_cast<NumericValue*>(this);
-    return num->getVal();
+    return static_cast<NumericValue*>(this)->getVal();
 }
 bool Value::isSeflEvaluating() {
-    if(dynamic_cast<BooleanValue*>(this)) return true;
-    if(dynamic_cast<NumericValue*>(this)) return true;
-    if(dynamic_cast<StringValue*>(this)) return true;
-    if(dynamic_cast<BuiltinProcValue*>(this)) return true;
-    return false;
+    return type == Type::Boolean || type == Type::Number || type == Type::String || type == Type::BuiltinProc;
 }
 std::optional<std::string> Value::asSymbol() {
-    SymbolValue* symbol = dynamic_cast<SymbolValue*>(this);
-    if (symbol) {
-        return symbol->toString();
+    if (type == Type::Symbol) {
+        return static_cast<SymbolValue*>(this)->getVal();
     } else {
         return std::nullopt;
     }
 }
-bool Value::isFalse() {
-    if (auto boolean = dynamic_cast<BooleanValue*>(this)) {
-        if (boolean->getVal() == false) return true;
+std::optional<SymbolId> Value::asSymbolId() {
+    if (type == Type::Symbol) {
+        return static_cast<SymbolValue*>(this)->getId();
+    } else {
+        return std::nullopt;
     }
-    return false; 
+}
+bool Value::isFalse() {
+    return type == Type::Boolean && !static_cast<BooleanValue*>(this)->getVal();
 }
 
 template <typename T>
 bool Value::isEqual(const Value& a, const Value& b) const {
-    const T* aT = dynamic_cast<const T*>(&a);
-    const T* bT = dynamic_cast<const T*>(&b);
-    return aT && bT && aT->getVal() == bT->getVal();
+    return a.type == b.type && static_cast<const T&>(a).getVal() == static_cast<const T&>(b).getVal();
 }
 bool NilValue::isEqual(const Value& other) const {
-    const NilValue* otherNil = dynamic_cast<const NilValue*>(&other);
-    return otherNil;
+    return other.getType() == Type::Nil;
 }
 bool PairValue::isEqual(const Value& other) const {
-    const PairValue* otherPair = dynamic_cast<const PairValue*>(&other);
-    return otherPair && left->isEqual(*otherPair->left) && right->isEqual(*otherPair->right);
+    if (other.getType() != Type::Pair) return false;
+    auto& otherPair = static_cast<const PairValue&>(other);
+    return left->isEqual(*otherPair.left) && right->isEqual(*otherPair.right);
 }
 bool BuiltinProcValue::isEqual(const Value& other) const {
-    const BuiltinProcValue* otherSymbol= dynamic_cast<const BuiltinProcValue*>(&other);
-    return otherSymbol && otherSymbol->getFunc() == this->getFunc();
+    return other.getType() == Type::BuiltinProc && static_cast<const BuiltinProcValue&>(other).getFunc() == this->getFunc();
 }
 bool LambdaValue::isEqual(const Value& other) const {
-    const LambdaValue* otherSymbol= dynamic_cast<const LambdaValue*>(&other);
-    return otherSymbol && otherSymbol == this;
+    return &other == this;
+}
+bool BoxValue::isEqual(const Value& other) const {
+    return &other == this;
+}
+bool PromiseValue::isEqual(const Value& other) const {
+    return &other == this;
 }
 
 //toVector函数
 std::vector<std::shared_ptr<Value>> Value::toVector() {
     std::vector<std::shared_ptr<Value>> vec;
-    PairValue* pair = dynamic_cast<PairValue*>(this);
-    while (pair) {
+    const Value* current = this;
+    while (current->type == Type::Pair) {
+        auto pair = static_cast<const PairValue*>(current);
         vec.push_back(pair->left);
-        PairValue* rightIsPair = dynamic_cast<PairValue*>(pair->right.get());
-        NilValue* rightIsNil = dynamic_cast<NilValue*>(pair->right.get());
-        if (rightIsPair) {
-            pair = rightIsPair;
-        } else if (rightIsNil) {
-            pair = nullptr;
-        } else {
-            throw LispError("Value cannot be converted to vector");
-        }
+        current = pair->right.get();
+    }
+    if (current != this && current->type != Type::Nil) {
+        throw LispError("Value cannot be converted to vector");
     }
     return vec;
 }
 
-BuiltinFuncType* BuiltinProcValue::getFunc() const {
+ValuePtr PromiseValue::force(EvalEnv& env) {
+    if (value) return value;
+    //求值过程中可能再次 force 这个承诺，先取出 proc 和 args，以先完成的结果为准
+    auto thunk = proc;
+    auto thunkArgs = args;
+    auto result = env.apply(thunk, thunkArgs);
+    if (!value) {
+        value = std::move(result);
+        proc = nullptr;
+        args.clear();
+    }
+    return value;
+}
+
+BuiltinProcValue::BuiltinFuncType* BuiltinProcValue::getFunc() const {
     return func;
 }
+ValuePtr BuiltinProcValue::call(std::span<const ValuePtr> args, EvalEnv& env) const {
+    int argc = static_cast<int>(args.size());
+    if (argc < minArgs || (maxArgs != VARIADIC && argc > maxArgs)) {
+        throw LispError("Incorrect number of arguments.");
+    }
+    if (argc == 1 && unary) {
+        return unary(args[0], env);
+    }
+    if (argc == 2 && binary) {
+        return binary(args[0], args[1], env);
+    }
+    return func(args, env);
+}
 
 
-ValuePtr LambdaValue::apply(const std::vector<ValuePtr>& args) {
+ValuePtr LambdaValue::apply(std::span<const ValuePtr> args) {
+    if (memo) {
+        return applyMemoized(args);
+    }
+    return invoke(args);
+}
+ValuePtr LambdaValue::applyMemoized(std::span<const ValuePtr> args) const {
+    auto hash = MemoTable::hash(args);
+    if (auto cached = memo->find(hash, args)) {
+        return cached;
+    }
+    //未命中时不作为尾调用继续循环，结果要在返回后写入缓存
+    auto result = invoke(args);
+    memo->insert(hash, args, result);
+    return result;
+}
+ValuePtr LambdaValue::memoized(std::size_t limit) const {
+    //即时编译的机器码和内联版本会绕过缓存，副本不沿用它们
+    auto copy = code ? std::make_shared<LambdaValue>(layout, code, initEnv)
+                     : std::make_shared<LambdaValue>(layout, arity, body, initEnv, nullptr, nullptr, reuseFrames);
+    copy->memo = std::make_shared<MemoTable>(limit);
+    return copy;
+}
+ValuePtr LambdaValue::invoke(std::span<const ValuePtr> args) const {
     //首先是创建一个新的 Lambda 内部求值环境。
-    //这个应当包含 LambdaValue::params 数据成员到 args 的一一绑定。
+    //这个应当包含形参（LambdaValue::layout 的前 arity 个槽位）到 args 的一一绑定。
     //然后，将它的上级环境设置为之前保存的 parent。
     //最后，在这个求值环境下对 body 数据成员的表达式逐一求值，返回最后一个即可。
-    auto child = initEnv->createChild(params, args);
-    ValuePtr res = nullptr;
-    for (auto expr : body) {
-        res = child->eval(expr);
-        //std::cout<<res->toString()<<'\n';
+    if (code) {
+        return VM::instance().call(*this, args);
+    }
+    //函数体最后的调用若仍是树求值的闭包，就换上它和它的实参继续循环，不再递归
+    //实参在 createChild 中复制进新帧后就不再使用，所以下一次尾调用可以直接覆盖 tail.args
+    const LambdaValue* lambda = this;
+    std::span<const ValuePtr> arguments = args;
+    ValuePtr current;//保证尾调用的闭包在循环中存活
+    TailCall tail;
+    while (true) {
+        if (arguments.size() != lambda->arity) {
+            throw LispError("Incorrect number of arguments.");
+        }
+        if (lambda->jit) {
+            if (auto result = lambda->jit->tryRun(*lambda, arguments)) return result;
+        }
+        ChildFrame child{*lambda->initEnv, lambda->layout, arguments, lambda->reuseFrames};
+        if (auto result = evalSequenceTail(*lambda->body, *child, tail)) {
+            return result;
+        }
+        if (tail.proc->getType() != Type::Lambda || static_cast<LambdaValue&>(*tail.proc).code) {
+            return child->apply(tail.proc, tail.args.span());
+        }
+        current = std::move(tail.proc);
+        lambda = static_cast<LambdaValue*>(current.get());
+        arguments = tail.args.span();
+        if (lambda->memo) {
+            return lambda->applyMemoized(arguments);
+        }
     }
-    return res;
 }
\ No newline at end of file
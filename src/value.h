@@ -5,8 +5,20 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include <span>
 #include "./eval_env.h"
 class EvalEnv;
+class Node;
+using NodePtr = std::shared_ptr<Node>;
+struct Chunk;
+class JitState;
+struct InlineBody;
+class MemoTable;
+
+using SymbolId = int;
+//活动帧的布局：按槽位顺序排列的名字，形参在前，函数体内部 define 的名字在后
+using FrameLayout = std::vector<SymbolId>;
+using FrameLayoutPtr = std::shared_ptr<const FrameLayout>;
 
 enum class Type {
     Number,
@@ -17,13 +29,18 @@ enum class Type {
     Pair,
     BuiltinProc,
     Lambda,
+    Box,
+    Promise,
 };
 
 class Value {
+    Type type;//类型标签，谓词和向下转型都直接比较它，不走 RTTI
 public:
-    Value();
+    Value(Type type);
     virtual ~Value();
-    virtual Type getType() const = 0;
+    Type getType() const {
+        return type;
+    }
     virtual std::string toString() const = 0;
     bool isNil();
     bool isNumber();
@@ -31,6 +48,7 @@ public:
     bool isList();
     bool isFalse();
     std::optional<std::string> asSymbol();
+    std::optional<SymbolId> asSymbolId();
     double asNumber();
     virtual bool isEqual(const Value& other) const = 0;
     
@@ -47,13 +65,11 @@ class BooleanValue : public Value {
     bool val;
 public:
     BooleanValue(const bool& val);
+    static ValuePtr create(bool val);//#t 和 #f 各只有一个共享实例，不再重复分配
     std::string toString() const override;
     bool getVal() const {
         return val;
     }
-    Type getType() const override {
-        return Type::Boolean;
-    }
     bool isEqual(const Value& other) const {
         return Value::isEqual<BooleanValue>(*this, other);
     }
@@ -67,9 +83,7 @@ class NumericValue : public Value {
     double val;
 public:
     NumericValue(const double& val);
-    Type getType() const override {
-        return Type::Number;
-    }
+    static ValuePtr create(double val);//小整数取自预分配的缓存，其余才新建
     std::string toString() const override;
     double getVal() const {
         return val;
@@ -82,9 +96,6 @@ class StringValue : public Value {
     std::string val;
 public:
     StringValue(const std::string& val);
-    Type getType() const override {
-        return Type::String;
-    }
     std::string toString() const override; 
     std::string getVal() const {
         return val;
@@ -98,27 +109,32 @@ public:
 class NilValue : public Value {
 public:
     NilValue();
-    Type getType() const override {
-        return Type::Nil;
-    }
+    static ValuePtr create();//空表是唯一的共享实例
     std::string toString() const override;
     bool isEqual(const Value& other) const override;
 };
 
 
+//符号在全局符号表中驻留：同名符号只有一个实例，并带有唯一的整数编号
 class SymbolValue : public Value {
     std::string symbol;
+    SymbolId id;
 public:
-    SymbolValue(const std::string& symbol);
-    Type getType() const override {
-        return Type::Symbol;
+    SymbolValue(const std::string& symbol, SymbolId id);
+    static std::shared_ptr<SymbolValue> intern(const std::string& symbol);
+    static SymbolId idOf(const std::string& symbol) {
+        return intern(symbol)->getId();
     }
+    static const std::string& nameOf(SymbolId id);
     std::string toString() const override;
-    std::string getVal() const {
+    const std::string& getVal() const {
         return symbol;
     }
-    bool isEqual(const Value& other) const {
-        return Value::isEqual<SymbolValue>(*this, other);
+    SymbolId getId() const {
+        return id;
+    }
+    bool isEqual(const Value& other) const override {
+        return &other == this;//驻留后同名即同一实例
     }
 };
 
@@ -128,11 +144,11 @@ class PairValue : public Value {
     std::shared_ptr<Value> right;
 public:
     PairValue(const std::shared_ptr<Value>& left, const std::shared_ptr<Value>& right);
-    Type getType() const override {
-        return Type::Pair;
-    }
+    static ValuePtr create(const ValuePtr& left, const ValuePtr& right);//从线程局部内存池分配
     std::string toString() const override;
     friend std::vector<std::shared_ptr<Value>> Value::toVector();
+    friend bool Value::isList();
+    friend class GarbageCollector;
     std::shared_ptr<Value> getCdr() {
         return right;
     }
@@ -150,32 +166,93 @@ public:
 };
 
 
+//可变绑定的存储单元。帧创建后才被 define 或会被 set! 改写的变量被闭包捕获时，帧和闭包共享同一个单元，
+//之后的 define 和赋值双方都能看到。只出现在帧的槽位中，不会作为值交给程序
+class BoxValue : public Value {
+    ValuePtr value;//尚未绑定时为空
+    friend class GarbageCollector;
+public:
+    BoxValue(ValuePtr value);
+    static ValuePtr create(ValuePtr value);
+    ValuePtr& get() {
+        return value;
+    }
+    std::string toString() const override;
+    bool isEqual(const Value& other) const override;
+};
+
+
+//delay 和 cons-stream 创建的承诺：第一次 force 时以 args 调用 proc，记住结果，之后直接返回它。
+//求值后不再引用 proc 和 args，已经走过的流前缀不会因为承诺而继续存活
+class PromiseValue : public Value {
+    ValuePtr proc;
+    std::vector<ValuePtr> args;
+    ValuePtr value;//尚未求值时为空
+    friend class GarbageCollector;
+public:
+    PromiseValue(ValuePtr proc, std::vector<ValuePtr> args);
+    ~PromiseValue();
+    static ValuePtr create(ValuePtr proc, std::vector<ValuePtr> args = {});
+    ValuePtr force(EvalEnv& env);
+    std::string toString() const override;
+    bool isEqual(const Value& other) const override;
+};
+
+
+//内置过程。实参以只读窗口传入，调用方不需要为实参分配 vector。
+//除通用入口外，常用的一元、二元过程还可以提供定长入口，省去按个数分派和检查。
 class BuiltinProcValue : public Value {
-    using BuiltinFuncType = ValuePtr(const std::vector<ValuePtr>&, EvalEnv&);
+public:
+    using BuiltinFuncType = ValuePtr(std::span<const ValuePtr>, EvalEnv&);
+    using UnaryFuncType = ValuePtr(const ValuePtr&, EvalEnv&);
+    using BinaryFuncType = ValuePtr(const ValuePtr&, const ValuePtr&, EvalEnv&);
+    static constexpr int VARIADIC = -1;
+private:
     BuiltinFuncType* func = nullptr;
+    int minArgs;
+    int maxArgs;//VARIADIC 表示不限
+    UnaryFuncType* unary = nullptr;
+    BinaryFuncType* binary = nullptr;
 public:
-    BuiltinProcValue(BuiltinFuncType* func);
-    Type getType() const override {
-        return Type::BuiltinProc;
-    }
+    BuiltinProcValue(BuiltinFuncType* func, int minArgs = 0, int maxArgs = VARIADIC,
+                     UnaryFuncType* unary = nullptr, BinaryFuncType* binary = nullptr);
     std::string toString() const override;
     BuiltinFuncType* getFunc() const;
     bool isEqual(const Value& other) const override;
+    //检查实参个数后调用，有定长入口时优先使用
+    ValuePtr call(std::span<const ValuePtr> args, EvalEnv& env) const;
 };
 
 
 class LambdaValue : public Value {
 private:
-    std::vector<std::string> params;
-    std::vector<ValuePtr> body;
+    FrameLayoutPtr layout;//调用时创建的帧的布局
+    std::size_t arity;//形参个数，即 layout 的前 arity 个槽位
+    std::shared_ptr<const std::vector<NodePtr>> body;//分析后的函数体，同一个 lambda 表达式创建的闭包共享
+    std::shared_ptr<const Chunk> code;//由 --vm 模式编译创建时为字节码，否则为空
     std::shared_ptr<EvalEnv> initEnv = nullptr;//被定义时的环境
+    std::shared_ptr<JitState> jit;//同一个 lambda 表达式创建的闭包共享的即时编译状态，可为空
+    std::shared_ptr<const InlineBody> inlined;//可以在调用点内联时为内联版本的函数体，否则为空
+    bool reuseFrames = false;//函数体不会捕获调用帧，帧从帧栈取得并在返回时归还
+    std::shared_ptr<MemoTable> memo;//由 memoize 创建时为结果缓存，否则为空
+    ValuePtr invoke(std::span<const ValuePtr> args) const;//不经过缓存的调用
+    ValuePtr applyMemoized(std::span<const ValuePtr> args) const;
+    friend class GarbageCollector;
+    friend class VM;
+    friend class JitState;
+    friend class JitCompiler;
+    friend class InlineCallNode;
 public:    
-    Type getType() const override {
-        return Type::Lambda;
-    }
-    LambdaValue(const std::vector<std::string>& params, const std::vector<ValuePtr>& body, std::shared_ptr<EvalEnv> initEnv);
+    LambdaValue(FrameLayoutPtr layout, std::size_t arity, std::shared_ptr<const std::vector<NodePtr>> body, std::shared_ptr<EvalEnv> initEnv,
+                std::shared_ptr<JitState> jit = nullptr, std::shared_ptr<const InlineBody> inlined = nullptr, bool reuseFrames = false);
+    LambdaValue(FrameLayoutPtr params, std::shared_ptr<const Chunk> code, std::shared_ptr<EvalEnv> initEnv);
     std::string toString() const override; // 如前所述，返回 #<procedure> 即可
-    ValuePtr apply(const std::vector<ValuePtr>& args);
+    ValuePtr apply(std::span<const ValuePtr> args);
+    //共享函数体和环境、带有独立结果缓存的副本。limit 为缓存项数的上限，0 表示不限制
+    ValuePtr memoized(std::size_t limit) const;
+    const MemoTable* memoTable() const {
+        return memo.get();
+    }
     bool isEqual(const Value& other) const override;
 };
 
@@ -0,0 +1,240 @@
+#include "./vm.h"
+#include "./analyze.h"
+#include "./builtins.h"
+#include "./compiler.h"
+#include "./error.h"
+
+//GCC 和 Clang 支持取标签地址，用跳转表做线索化分派；其他编译器退回 switch
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+VM& VM::instance() {
+    thread_local VM vm;
+    return vm;
+}
+
+ValuePtr VM::eval(const ValuePtr& expr, std::shared_ptr<EvalEnv> env) {
+    return run(Compiler::compileTopLevel(expr), std::move(env));
+}
+
+ValuePtr VM::call(const LambdaValue& lambda, std::span<const ValuePtr> args) {
+    if (args.size() != lambda.arity) {
+        throw LispError("Incorrect number of arguments.");
+    }
+    return run(lambda.code, lambda.initEnv->createChild(lambda.layout, args));
+}
+
+ValuePtr VM::run(std::shared_ptr<const Chunk> entryChunk, std::shared_ptr<EvalEnv> entryEnv) {
+    const std::size_t entryDepth = frames.size();
+    const std::size_t entryStack = stack.size();
+    frames.push_back({std::move(entryChunk), 0, std::move(entryEnv), stack.size()});
+
+    Frame* frame = &frames.back();
+    const std::int32_t* code = frame->chunk->code.data();
+    std::size_t pc = 0;
+    auto reload = [&] {
+        frame = &frames.back();
+        code = frame->chunk->code.data();
+        pc = frame->pc;
+    };
+    auto pop = [&] {
+        ValuePtr value = std::move(stack.back());
+        stack.pop_back();
+        return value;
+    };
+    //栈顶的 argc 个实参。只能在不会重入虚拟机的地方直接使用
+    auto topArgs = [&](std::int32_t argc) {
+        return std::span<const ValuePtr>(stack.data() + stack.size() - argc, argc);
+    };
+    //内置过程可能回调闭包而使栈扩容，调用前先把实参移到 C++ 栈上的窗口中
+    auto popArgs = [&](std::int32_t argc, ArgBuffer& args) {
+        args.reset(argc);
+        for (std::int32_t i = 0; i < argc; ++i) {
+            args[i] = std::move(stack[stack.size() - argc + i]);
+        }
+        stack.resize(stack.size() - argc);
+    };
+
+    try {
+#ifdef VM_COMPUTED_GOTO
+        static void* const dispatchTable[] = {
+            &&op_Const, &&op_Load, &&op_Define, &&op_Set, &&op_Pop, &&op_Jump, &&op_JumpIfFalse,
+            &&op_JumpIfFalseKeep, &&op_JumpIfTrueKeep, &&op_Closure, &&op_Call, &&op_TailCall,
+            &&op_Return, &&op_EnterLet, &&op_LeaveLet, &&op_Form, &&op_Fail, &&op_Primitive,
+        };
+#define DISPATCH() goto* dispatchTable[code[pc++]]
+#define CASE(op) op_##op:
+        DISPATCH();
+#else
+#define DISPATCH() continue
+#define CASE(op) case OpCode::op:
+        for (;;) switch (static_cast<OpCode>(code[pc++])) {
+#endif
+        CASE(Const) {
+            stack.push_back(frame->chunk->constants[code[pc++]]);
+            DISPATCH();
+        }
+        CASE(Load) {
+            stack.push_back(frame->env->lookupBinding(code[pc++]));
+            DISPATCH();
+        }
+        CASE(Define) {
+            frame->env->defineBinding(code[pc++], pop());
+            stack.push_back(NilValue::create());
+            DISPATCH();
+        }
+        CASE(Set) {
+            frame->env->setBinding(code[pc++], pop());
+            stack.push_back(NilValue::create());
+            DISPATCH();
+        }
+        CASE(Pop) {
+            stack.pop_back();
+            DISPATCH();
+        }
+        CASE(Jump) {
+            pc = code[pc];
+            DISPATCH();
+        }
+        CASE(JumpIfFalse) {
+            if (pop()->isFalse()) {
+                pc = code[pc];
+            } else {
+                ++pc;
+            }
+            DISPATCH();
+        }
+        CASE(JumpIfFalseKeep) {
+            if (stack.back()->isFalse()) {
+                pc = code[pc];
+            } else {
+                stack.pop_back();
+                ++pc;
+            }
+            DISPATCH();
+        }
+        CASE(JumpIfTrueKeep) {
+            if (!stack.back()->isFalse()) {
+                pc = code[pc];
+            } else {
+                stack.pop_back();
+                ++pc;
+            }
+            DISPATCH();
+        }
+        CASE(Closure) {
+            auto& prototype = frame->chunk->prototypes[code[pc++]];
+            stack.push_back(std::make_shared<LambdaValue>(prototype.params, prototype.chunk, frame->env));
+            DISPATCH();
+        }
+        CASE(Call) {
+            std::int32_t argc = code[pc++];
+            auto& procSlot = stack[stack.size() - argc - 1];
+            if (procSlot->getType() == Type::Lambda && static_cast<LambdaValue&>(*procSlot).code && !static_cast<LambdaValue&>(*procSlot).memo) {
+                auto proc = std::move(procSlot);
+                auto& lambda = static_cast<LambdaValue&>(*proc);
+                if (static_cast<std::size_t>(argc) != lambda.arity) {
+                    throw LispError("Incorrect number of arguments.");
+                }
+                auto env = lambda.initEnv->createChild(lambda.layout, topArgs(argc));
+                stack.resize(stack.size() - argc - 1);
+                frame->pc = pc;
+                frames.push_back({lambda.code, 0, std::move(env), stack.size()});
+                reload();
+            } else {
+                ArgBuffer args;
+                popArgs(argc, args);
+                auto proc = pop();
+                auto result = frame->env->apply(proc, args.span());
+                frame = &frames.back();//回调可能重入虚拟机并使 frames 扩容
+                stack.push_back(std::move(result));
+            }
+            DISPATCH();
+        }
+        CASE(TailCall) {
+            std::int32_t argc = code[pc++];
+            auto& procSlot = stack[stack.size() - argc - 1];
+            if (procSlot->getType() == Type::Lambda && static_cast<LambdaValue&>(*procSlot).code && !static_cast<LambdaValue&>(*procSlot).memo) {
+                auto proc = std::move(procSlot);
+                auto& lambda = static_cast<LambdaValue&>(*proc);
+                if (static_cast<std::size_t>(argc) != lambda.arity) {
+                    throw LispError("Incorrect number of arguments.");
+                }
+                //复用当前帧：丢弃本帧的操作数，换上被调用者的代码和环境
+                frame->env = lambda.initEnv->createChild(lambda.layout, topArgs(argc));
+                stack.resize(frame->base);
+                frame->chunk = lambda.code;
+                frame->pc = 0;
+                reload();
+                DISPATCH();
+            }
+            ArgBuffer args;
+            popArgs(argc, args);
+            auto proc = pop();
+            auto result = frame->env->apply(proc, args.span());
+            frame = &frames.back();
+            stack.push_back(std::move(result));
+            goto op_Return_impl;
+        }
+        CASE(Return) {
+        op_Return_impl:
+            ValuePtr result = pop();
+            stack.resize(frame->base);
+            frames.pop_back();
+            if (frames.size() == entryDepth) {
+                return result;
+            }
+            stack.push_back(std::move(result));
+            reload();
+            DISPATCH();
+        }
+        CASE(EnterLet) {
+            auto& params = frame->chunk->letParams[code[pc++]];
+            auto argc = static_cast<std::int32_t>(params->size());
+            frame->env = frame->env->createChild(params, topArgs(argc));
+            stack.resize(stack.size() - argc);
+            DISPATCH();
+        }
+        CASE(LeaveLet) {
+            frame->env = frame->env->parent;
+            DISPATCH();
+        }
+        CASE(Form) {
+            auto result = frame->chunk->forms[code[pc++]]->eval(*frame->env);
+            frame = &frames.back();
+            stack.push_back(std::move(result));
+            DISPATCH();
+        }
+        CASE(Fail) {
+            throw LispError(static_cast<StringValue&>(*frame->chunk->constants[code[pc++]]).getVal());
+        }
+        CASE(Primitive) {
+            auto op = static_cast<::Primitive>(code[pc++]);
+            auto& builtin = frame->chunk->constants[code[pc++]];
+            auto size = stack.size();
+            auto& x = stack[size - 2];
+            auto& y = stack[size - 1];
+            if (stack[size - 3] == builtin && x->getType() == Type::Number && y->getType() == Type::Number) {
+                auto result = computePrimitive(op, static_cast<NumericValue&>(*x).getVal(), static_cast<NumericValue&>(*y).getVal());
+                stack.resize(size - 3);
+                stack.push_back(std::move(result));
+                if (static_cast<OpCode>(code[pc]) == OpCode::TailCall) {
+                    goto op_Return_impl;
+                }
+                pc += 2;
+            }
+            DISPATCH();
+        }
+#ifndef VM_COMPUTED_GOTO
+        }
+#endif
+#undef DISPATCH
+#undef CASE
+    } catch (...) {
+        //出错时丢弃本次执行压入的帧和操作数，虚拟机回到进入 run 之前的状态
+        frames.resize(entryDepth);
+        stack.resize(entryStack);
+        throw;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef VM_H
+#define VM_H
+#include <memory>
+#include <vector>
+#include "./bytecode.h"
+#include "./eval_env.h"
+
+//执行字节码的栈式虚拟机。
+//过程调用在 frames 中压入新帧而不是递归调用 C++ 函数，尾调用直接复用当前帧，
+//因此 Lisp 层面的递归深度不受 C++ 栈限制。
+//run 可以重入：内置过程（如 map）回调闭包时会在同一个虚拟机上开始新一段执行。
+class VM {
+    struct Frame {
+        std::shared_ptr<const Chunk> chunk;
+        std::size_t pc;
+        std::shared_ptr<EvalEnv> env;
+        std::size_t base;//本帧在操作数栈上的起始位置
+    };
+    std::vector<ValuePtr> stack;
+    std::vector<Frame> frames;
+    ValuePtr run(std::shared_ptr<const Chunk> chunk, std::shared_ptr<EvalEnv> env);
+public:
+    static VM& instance();//每个线程一个虚拟机
+    //编译并在 env 中执行一个顶层表达式
+    ValuePtr eval(const ValuePtr& expr, std::shared_ptr<EvalEnv> env);
+    //调用一个已编译的闭包，供 LambdaValue::apply 使用
+    ValuePtr call(const LambdaValue& lambda, std::span<const ValuePtr> args);
+};
+
+#endif